@@ -12,8 +12,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <memory>
+#include <utility>
 
-#define OCX_API_VERSION 20201012ull
+#define OCX_API_VERSION 20261018ull
 
 #ifdef _MSC_VER
 #  ifdef OCX_STATIC
@@ -66,6 +67,19 @@ namespace ocx {
         HINT_SEVL,
     };
 
+    // extension ids hold the extension number in the upper and the version
+    // of its interface in the lower 16 bits
+    enum extension_id : u64 {
+        EXT_CORE_INV_RANGE    = 0x00010001,
+        EXT_CORE_TRACE_INSNS  = 0x00020001,
+        EXT_ENV_TRACE_INSNS   = 0x00030001,
+        EXT_ENV_SET_EXCLUSIVE = 0x00040001,
+        EXT_ENV_CALLBACKS     = 0x00050001,
+        EXT_CORE_ASYNC_STEP   = 0x00060001,
+        EXT_ENV_ASYNC_STEP    = 0x00070001,
+        EXT_CORE_STEP_TIME    = 0x00080001,
+    };
+
     class env
     {
     public:
@@ -94,20 +108,110 @@ namespace ocx {
         virtual bool handle_breakpoint(u64 vaddr) = 0;
         virtual bool handle_watchpoint(u64 vaddr, u64 size, u64 data,
                                        bool iswr) = 0;
+
+        virtual void* query_extension(u64 id);
     };
 
     class env_trace_insns_extension
     {
     public:
+        enum : u64 { ID = EXT_ENV_TRACE_INSNS };
         virtual void handle_trace_insn(u64 vaddr, size_t size) = 0;
     };
 
     class env_set_exclusive_extension
     {
     public:
+        enum : u64 { ID = EXT_ENV_SET_EXCLUSIVE };
         virtual void set_exclusive(bool excl) = 0;
     };
 
+    class env_async_step_extension
+    {
+    public:
+        enum : u64 { ID = EXT_ENV_ASYNC_STEP };
+        virtual void step_complete(u64 num_insn) = 0;
+    };
+
+    struct env_callbacks {
+        void* ctx;
+        u8* (*get_page_ptr_r)(void* ctx, u64 page_paddr);
+        u8* (*get_page_ptr_w)(void* ctx, u64 page_paddr);
+        response (*transport)(void* ctx, const transaction& tx);
+        void (*handle_begin_basic_block)(void* ctx, u64 vaddr);
+    };
+
+    class env_callbacks_extension
+    {
+    public:
+        enum : u64 { ID = EXT_ENV_CALLBACKS };
+        virtual const env_callbacks* get_callbacks() = 0;
+    };
+
+    // Publishes the hot callbacks of ENV as plain function pointers that
+    // bypass the env vtable. The thunks call ENV's implementation without
+    // virtual dispatch, so ENV must be the most derived implementation of
+    // these callbacks.
+    template <class ENV>
+    class env_callbacks_adapter : public ENV, public env_callbacks_extension
+    {
+    private:
+        env_callbacks m_callbacks;
+
+        static u8* do_get_page_ptr_r(void* ctx, u64 page_paddr) {
+            return static_cast<ENV*>(ctx)->ENV::get_page_ptr_r(page_paddr);
+        }
+
+        static u8* do_get_page_ptr_w(void* ctx, u64 page_paddr) {
+            return static_cast<ENV*>(ctx)->ENV::get_page_ptr_w(page_paddr);
+        }
+
+        static response do_transport(void* ctx, const transaction& tx) {
+            return static_cast<ENV*>(ctx)->ENV::transport(tx);
+        }
+
+        static void do_handle_begin_basic_block(void* ctx, u64 vaddr) {
+            static_cast<ENV*>(ctx)->ENV::handle_begin_basic_block(vaddr);
+        }
+
+    public:
+        template <typename... ARGS>
+        env_callbacks_adapter(ARGS&&... args):
+            ENV(std::forward<ARGS>(args)...),
+            m_callbacks() {
+            m_callbacks.ctx = static_cast<ENV*>(this);
+            m_callbacks.get_page_ptr_r = &do_get_page_ptr_r;
+            m_callbacks.get_page_ptr_w = &do_get_page_ptr_w;
+            m_callbacks.transport = &do_transport;
+            m_callbacks.handle_begin_basic_block = &do_handle_begin_basic_block;
+        }
+
+        virtual const env_callbacks* get_callbacks() override {
+            return &m_callbacks;
+        }
+
+        virtual void* query_extension(u64 id) override {
+            if (id == env_callbacks_extension::ID)
+                return static_cast<env_callbacks_extension*>(this);
+            return ENV::query_extension(id);
+        }
+    };
+
+    inline void* env::query_extension(u64 id) {
+        switch (id) {
+        case env_trace_insns_extension::ID:
+            return dynamic_cast<env_trace_insns_extension*>(this);
+        case env_set_exclusive_extension::ID:
+            return dynamic_cast<env_set_exclusive_extension*>(this);
+        case env_callbacks_extension::ID:
+            return dynamic_cast<env_callbacks_extension*>(this);
+        case env_async_step_extension::ID:
+            return dynamic_cast<env_async_step_extension*>(this);
+        default:
+            return nullptr;
+        }
+    }
+
     class core
     {
     protected:
@@ -162,20 +266,74 @@ namespace ocx {
 
         virtual void tb_flush() = 0;
         virtual void tb_flush_page(u64 start, u64 end) = 0;
+
+        virtual void* query_extension(u64 id);
     };
 
     class core_inv_range_extension
     {
     public:
+        enum : u64 { ID = EXT_CORE_INV_RANGE };
         virtual void invalidate_page_ptrs(u64 start, u64 end) = 0;
     };
 
     class core_trace_insns_extension
     {
     public:
+        enum : u64 { ID = EXT_CORE_TRACE_INSNS };
         virtual bool trace_insns(bool on) = 0;
     };
 
+    // Starts a quantum on a core owned thread and returns immediately. Once
+    // the quantum has finished the core calls step_complete on the env, if
+    // it implements env_async_step_extension, from an arbitrary thread and
+    // step_poll returns the number of executed instructions exactly once.
+    // stop() ends a running quantum early just like it does for step().
+    class core_async_step_extension
+    {
+    public:
+        enum : u64 { ID = EXT_CORE_ASYNC_STEP };
+        virtual bool step_async(u64 num_insn) = 0;
+        virtual bool step_poll(u64& num_insn) = 0;
+    };
+
+    // Steps a core by simulated time rather than by instructions. step_time
+    // executes until the local time of the core has advanced by budget_ps,
+    // max_insn instructions have been executed (0 = no limit) or stop() is
+    // called, whichever comes first; hosts pass the time until their next
+    // deadline or pending event as budget. The core may return early, e.g.
+    // when it waits for an interrupt. It returns the number of executed
+    // instructions and stores the exact simulated time consumed in used_ps.
+    class core_step_time_extension
+    {
+    public:
+        enum : u64 { ID = EXT_CORE_STEP_TIME };
+        virtual u64 step_time(u64 budget_ps, u64 max_insn, u64& used_ps) = 0;
+    };
+
+    // the default implementations resolve extensions with dynamic_cast
+    // inside the module that implements the object, so that RTTI never has
+    // to match across library boundaries; callers should cache the result
+    inline void* core::query_extension(u64 id) {
+        switch (id) {
+        case core_inv_range_extension::ID:
+            return dynamic_cast<core_inv_range_extension*>(this);
+        case core_trace_insns_extension::ID:
+            return dynamic_cast<core_trace_insns_extension*>(this);
+        case core_async_step_extension::ID:
+            return dynamic_cast<core_async_step_extension*>(this);
+        case core_step_time_extension::ID:
+            return dynamic_cast<core_step_time_extension*>(this);
+        default:
+            return nullptr;
+        }
+    }
+
+    template <class EXT, class T>
+    inline EXT* query_extension(T& obj) {
+        return static_cast<EXT*>(obj.query_extension(EXT::ID));
+    }
+
     extern OCX_API core* create_instance(u64 ver, env& e, const char* variant);
     extern OCX_API void  delete_instance(core* c);
 
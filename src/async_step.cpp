@@ -0,0 +1,57 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "async_step.h"
+
+#include <inttypes.h>
+
+namespace ocx {
+
+    async_step::async_step(runenv& env, core_async_step_extension* ext,
+                           u64 num_insn) :
+        m_env(env),
+        m_ext(ext),
+        m_thread(),
+        m_done(false),
+        m_result(0),
+        m_resume() {
+        if (m_ext != nullptr) {
+            ERROR_ON(!m_ext->step_async(num_insn),
+                     "core %" PRIu64 " is still busy", m_env.get_id());
+            return;
+        }
+
+        m_thread = std::thread([this, num_insn]() {
+            m_result = m_env.get_core()->step(num_insn);
+            m_done = true;
+            m_env.step_complete(m_result);
+        });
+    }
+
+    async_step::~async_step() {
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    bool async_step::poll() {
+        if (!m_done) {
+            if (m_ext == nullptr || !m_ext->step_poll(m_result))
+                return false;
+            m_done = true;
+        }
+
+        if (m_resume) {
+            std::function<void()> resume;
+            resume.swap(m_resume);
+            resume();
+        }
+
+        return true;
+    }
+
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef ASYNC_STEP_H
+#define ASYNC_STEP_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "ocx/ocx.h"
+#include "runenv.h"
+
+namespace ocx {
+
+    // Runs one quantum on a core without blocking the calling thread. Cores
+    // that implement core_async_step_extension run the quantum themselves,
+    // all others are stepped on a helper thread. Completion is reported to
+    // the env via step_complete and can be polled. The class also provides
+    // the awaitable interface, so that C++20 coroutines can co_await it; a
+    // suspended coroutine is resumed from the poll call that sees completion.
+    class async_step
+    {
+    private:
+        runenv&                    m_env;
+        core_async_step_extension* m_ext;
+        std::thread                m_thread;
+        std::atomic<bool>          m_done;
+        u64                        m_result;
+        std::function<void()>      m_resume;
+
+        async_step() = delete;
+        async_step(const async_step&) = delete;
+
+    public:
+        async_step(runenv& env, core_async_step_extension* ext, u64 num_insn);
+        virtual ~async_step();
+
+        bool poll();
+
+        inline u64 result() const { return m_result; }
+
+        inline bool await_ready() { return poll(); }
+        inline u64 await_resume() { return m_result; }
+
+        template <typename HANDLE>
+        inline void await_suspend(HANDLE handle) {
+            m_resume = [handle]() mutable { handle.resume(); };
+        }
+    };
+
+}
+
+#endif
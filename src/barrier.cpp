@@ -0,0 +1,229 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "barrier.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <climits>
+#include <chrono>
+#include <thread>
+
+namespace ocx {
+
+    // number of polls before a waiting thread gives up its host cpu; when
+    // there are more participants than host cpus, spinning only delays the
+    // threads we are waiting for, so we give up the cpu right away
+    static const int SPIN_LIMIT = 4000;
+
+    static int spin_limit(size_t count) {
+        size_t ncpus = std::thread::hardware_concurrency();
+        return (ncpus == 0 || count <= ncpus) ? SPIN_LIMIT : 0;
+    }
+
+    static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    static inline void futex_wait(std::atomic<u32>* addr, u32 val) {
+#ifdef __linux__
+        syscall(SYS_futex, (u32*)addr, FUTEX_WAIT_PRIVATE, val, nullptr,
+                nullptr, 0);
+#else
+        (void)addr;
+        (void)val;
+        std::this_thread::yield();
+#endif
+    }
+
+    static inline void futex_wake(std::atomic<u32>* addr) {
+#ifdef __linux__
+        syscall(SYS_futex, (u32*)addr, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+                nullptr, 0);
+#else
+        (void)addr;
+#endif
+    }
+
+    barrier::barrier(size_t count) :
+        m_stats(count),
+        m_count(count),
+        m_spin_limit(spin_limit(count)) {
+        ERROR_ON(count == 0, "barrier needs at least one participant");
+    }
+
+    barrier::~barrier() {
+    }
+
+    void barrier::spin_or_yield(int& spins) const {
+        if (spins++ < m_spin_limit)
+            cpu_relax();
+        else
+            std::this_thread::yield();
+    }
+
+    bool barrier::wait(size_t id, bool flag) {
+        auto start = std::chrono::steady_clock::now();
+        bool result = do_wait(id, flag);
+        auto end = std::chrono::steady_clock::now();
+
+        stats& s = m_stats[id];
+        s.wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         end - start).count();
+        s.rounds++;
+        return result;
+    }
+
+    barrier* barrier::create(barrier_kind kind, size_t count, u64 lag) {
+        switch (kind) {
+        case BARRIER_CENTRAL:
+            return new central_barrier(count);
+        case BARRIER_DISSEMINATION:
+            return new dissemination_barrier(count);
+        case BARRIER_RELAXED:
+            return new relaxed_barrier(count, lag);
+        default:
+            ERROR("unknown barrier kind %d", (int)kind);
+        }
+    }
+
+    central_barrier::central_barrier(size_t count) :
+        barrier(count),
+        m_generation(0),
+        m_sleepers(0),
+        m_arrived(0) {
+        m_flags[0] = false;
+        m_flags[1] = false;
+        m_results[0] = false;
+        m_results[1] = false;
+    }
+
+    central_barrier::~central_barrier() {
+    }
+
+    bool central_barrier::do_wait(size_t id, bool flag) {
+        (void)id;
+
+        // rounds alternate between two flag slots, a slot can only be
+        // reused once every thread has left the round that last used it
+        u32 gen = m_generation;
+        if (flag)
+            m_flags[gen & 1] = true;
+
+        if (m_arrived.fetch_add(1) + 1 == m_count) {
+            m_arrived = 0;
+            m_results[gen & 1] = m_flags[gen & 1].exchange(false);
+            m_generation = gen + 1;
+            if (m_sleepers > 0)
+                futex_wake(&m_generation);
+            return m_results[gen & 1];
+        }
+
+        for (int spins = 0; m_generation == gen; ++spins) {
+            if (spins < m_spin_limit) {
+                cpu_relax();
+                continue;
+            }
+
+            m_sleepers++;
+            futex_wait(&m_generation, gen);
+            m_sleepers--;
+        }
+
+        return m_results[gen & 1];
+    }
+
+    dissemination_barrier::dissemination_barrier(size_t count) :
+        barrier(count),
+        m_rounds(0),
+        m_epochs(count, 0),
+        m_slots() {
+        while (((size_t)1 << m_rounds) < count)
+            m_rounds++;
+
+        m_slots = std::vector<slot>(2 * count * m_rounds);
+        for (auto& s : m_slots)
+            s.epoch = 0;
+    }
+
+    dissemination_barrier::~dissemination_barrier() {
+    }
+
+    dissemination_barrier::slot&
+    dissemination_barrier::get_slot(u64 parity, size_t id, size_t round) {
+        return m_slots[(parity * m_count + id) * m_rounds + round];
+    }
+
+    bool dissemination_barrier::do_wait(size_t id, bool flag) {
+        // slots hold the epoch of their last signal shifted left by one and
+        // the accumulated flag of the sender in bit zero; after round k a
+        // thread has seen the flags of the 2^(k+1) threads before it
+        u64 epoch = ++m_epochs[id];
+        u64 parity = epoch & 1;
+        u64 bit = flag ? 1 : 0;
+
+        for (size_t k = 0; k < m_rounds; ++k) {
+            size_t partner = (id + ((size_t)1 << k)) % m_count;
+            get_slot(parity, partner, k).epoch = (epoch << 1) | bit;
+
+            slot& mine = get_slot(parity, id, k);
+            int spins = 0;
+            u64 val;
+            while (((val = mine.epoch) >> 1) != epoch)
+                spin_or_yield(spins);
+            bit |= val & 1;
+        }
+
+        return bit != 0;
+    }
+
+    relaxed_barrier::relaxed_barrier(size_t count, u64 lag) :
+        barrier(count),
+        m_lag(lag),
+        m_flag(false),
+        m_slots(count) {
+        for (auto& s : m_slots)
+            s.round = 0;
+    }
+
+    relaxed_barrier::~relaxed_barrier() {
+    }
+
+    u64 relaxed_barrier::min_round() const {
+        u64 result = ~0ull;
+        for (auto& s : m_slots) {
+            u64 round = s.round;
+            if (round < result)
+                result = round;
+        }
+        return result;
+    }
+
+    bool relaxed_barrier::do_wait(size_t id, bool flag) {
+        if (flag)
+            m_flag = true;
+
+        u64 round = m_slots[id].round + 1;
+        m_slots[id].round = round;
+
+        int spins = 0;
+        while (!m_flag && min_round() + m_lag < round)
+            spin_or_yield(spins);
+
+        return m_flag;
+    }
+
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <atomic>
+#include <vector>
+
+#include "ocx/ocx.h"
+
+namespace ocx {
+
+    enum barrier_kind {
+        BARRIER_CENTRAL = 0,   // shared counter, spins then sleeps on futex
+        BARRIER_DISSEMINATION, // log2(n) rounds of pairwise signalling
+        BARRIER_RELAXED,       // cores may run ahead by a bounded lag
+    };
+
+    // Quantum barrier for a fixed number of threads, identified by their id.
+    // Every participant passes a flag to wait, which returns the logical OR
+    // of the flags of all participants in that round, so that all threads
+    // can agree on leaving a lockstep loop in the same round. The relaxed
+    // barrier only guarantees that a set flag is eventually seen by all.
+    class barrier
+    {
+    private:
+        struct stats {
+            u64  wait_ns;
+            u64  rounds;
+            char pad[48];
+        };
+
+        std::vector<stats> m_stats;
+
+        barrier() = delete;
+        barrier(const barrier&) = delete;
+
+    protected:
+        const size_t m_count;
+        const int    m_spin_limit;
+
+        void spin_or_yield(int& spins) const;
+
+        virtual bool do_wait(size_t id, bool flag) = 0;
+
+    public:
+        barrier(size_t count);
+        virtual ~barrier();
+
+        inline size_t get_count() const { return m_count; }
+
+        inline u64 wait_ns(size_t id) const { return m_stats.at(id).wait_ns; }
+        inline u64 rounds(size_t id)  const { return m_stats.at(id).rounds; }
+
+        bool wait(size_t id, bool flag);
+
+        static barrier* create(barrier_kind kind, size_t count, u64 lag);
+    };
+
+    class central_barrier : public barrier
+    {
+    private:
+        std::atomic<u32>  m_generation;
+        std::atomic<u32>  m_sleepers;
+        std::atomic<u64>  m_arrived;
+        std::atomic<bool> m_flags[2];
+        bool              m_results[2];
+
+    protected:
+        virtual bool do_wait(size_t id, bool flag) override;
+
+    public:
+        central_barrier(size_t count);
+        virtual ~central_barrier();
+    };
+
+    class dissemination_barrier : public barrier
+    {
+    private:
+        struct slot {
+            std::atomic<u64> epoch;
+            char             pad[56];
+        };
+
+        size_t            m_rounds;
+        std::vector<u64>  m_epochs;
+        std::vector<slot> m_slots;
+
+        slot& get_slot(u64 parity, size_t id, size_t round);
+
+    protected:
+        virtual bool do_wait(size_t id, bool flag) override;
+
+    public:
+        dissemination_barrier(size_t count);
+        virtual ~dissemination_barrier();
+    };
+
+    class relaxed_barrier : public barrier
+    {
+    private:
+        struct slot {
+            std::atomic<u64> round;
+            char             pad[56];
+        };
+
+        u64               m_lag;
+        std::atomic<bool> m_flag;
+        std::vector<slot> m_slots;
+
+        u64 min_round() const;
+
+    protected:
+        virtual bool do_wait(size_t id, bool flag) override;
+
+    public:
+        relaxed_barrier(size_t count, u64 lag);
+        virtual ~relaxed_barrier();
+    };
+
+}
+
+#endif
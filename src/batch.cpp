@@ -0,0 +1,217 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "batch.h"
+#include "platform.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace ocx {
+
+    batch::batch(create_fn create, delete_fn destroy, u64 memsize,
+                 u64 ncores, u64 quantum, u64 limit) :
+        m_create(create),
+        m_delete(destroy),
+        m_memsize(memsize),
+        m_ncores(ncores),
+        m_quantum(quantum),
+        m_quantum_ps(0),
+        m_limit(limit),
+        m_images(),
+        m_regions(),
+        m_jobs(),
+        m_results(),
+        m_next(0),
+        m_secs(0.0) {
+    }
+
+    batch::~batch() {
+    }
+
+    const image* batch::open_image(const char* path) {
+        // images are opened before any job runs, so that missing files are
+        // reported up front
+        auto& img = m_images[path];
+        if (img == nullptr) {
+            FILE* f = fopen(path, "rb");
+            if (f == nullptr) {
+                fprintf(stderr, "unable to read %s: %s\n", path,
+                        strerror(errno));
+                m_images.erase(path);
+                return nullptr;
+            }
+
+            fclose(f);
+            img.reset(new image(path));
+        }
+
+        return img.get();
+    }
+
+    void batch::add_alias(u64 addr, u64 target, u64 size) {
+        m_regions.push_back(region{ addr, target, size, nullptr });
+    }
+
+    bool batch::add_rom(u64 addr, const char* path) {
+        const image* img = open_image(path);
+        if (img == nullptr)
+            return false;
+
+        m_regions.push_back(region{ addr, 0, img->get_size(), img });
+        return true;
+    }
+
+    bool batch::read_jobs(FILE* jobs) {
+        char line[4096];
+        for (size_t lineno = 1; fgets(line, sizeof(line), jobs) != nullptr;
+             ++lineno) {
+            line[strcspn(line, "\r\n")] = '\0';
+
+            char name[1024], path[2048];
+            unsigned long long limit = m_limit;
+            int n = sscanf(line, "%1023s %2047s %llu", name, path, &limit);
+            if (n <= 0 || name[0] == '#')
+                continue;
+
+            if (n < 2) {
+                fprintf(stderr, "job list line %zu: image missing\n", lineno);
+                return false;
+            }
+
+            const image* img = open_image(path);
+            if (img == nullptr) {
+                fprintf(stderr, "job list line %zu: invalid image\n",
+                        lineno);
+                return false;
+            }
+
+            if (img->get_size() > m_memsize) {
+                fprintf(stderr, "job list line %zu: %s does not fit into "
+                        "memory\n", lineno, path);
+                return false;
+            }
+
+            m_jobs.push_back(job{ name, img, limit });
+        }
+
+        return true;
+    }
+
+    void batch::run_job(const job& j, result& res) {
+        auto start = std::chrono::steady_clock::now();
+
+        res.status = STATUS_FAILED;
+        res.exit_code = -1;
+        res.insns = 0;
+        res.host_ms = 0.0;
+        res.checksum = 0;
+
+        std::string path = j.name + ".out";
+        FILE* uart = fopen(path.c_str(), "w");
+        if (uart == nullptr) {
+            INFO("unable to open %s: %s", path.c_str(), strerror(errno));
+            return;
+        }
+
+        bool shareable = false;
+        for (auto& r : m_regions)
+            shareable |= r.img == nullptr;
+
+        memory mem(m_memsize, 0x1000, shareable);
+        mem.load(*j.img);
+        for (auto& r : m_regions) {
+            if (r.img != nullptr)
+                mem.map_rom(r.addr, *r.img);
+            else
+                mem.alias(r.addr, r.target, r.size);
+        }
+
+        platform plat(mem);
+        plat.set_uart(uart);
+        plat.set_time_quantum(m_quantum_ps);
+
+        std::vector<core*> cores;
+        for (u64 i = 0; i < m_ncores; ++i) {
+            runenv& env = plat.create_env();
+            core* c = m_create(env);
+            if (c == nullptr)
+                break;
+
+            u64 reset_pc = 0;
+            c->write_reg(c->pc_regid(), &reset_pc);
+            plat.add_core(env, c);
+            cores.push_back(c);
+        }
+
+        if (cores.size() == m_ncores) {
+            plat.run_serial(m_quantum, j.limit);
+            res.status = plat.exited() ? STATUS_EXITED : STATUS_LIMIT;
+            res.exit_code = plat.exit_code();
+            res.insns = plat.insn_count();
+            res.checksum = plat.checksum();
+        }
+
+        for (auto c : cores)
+            m_delete(c);
+        fclose(uart);
+
+        auto end = std::chrono::steady_clock::now();
+        res.host_ms = std::chrono::duration<double, std::milli>(end - start)
+                      .count();
+    }
+
+    void batch::worker() {
+        for (;;) {
+            size_t i = m_next++;
+            if (i >= m_jobs.size())
+                break;
+            run_job(m_jobs[i], m_results[i]);
+        }
+    }
+
+    void batch::run(size_t nthreads) {
+        auto start = std::chrono::steady_clock::now();
+
+        m_results.resize(m_jobs.size());
+        m_next = 0;
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < std::max<size_t>(nthreads, 1); ++i)
+            threads.emplace_back(&batch::worker, this);
+        for (auto& t : threads)
+            t.join();
+
+        m_secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    int batch::write_summary(FILE* out) const {
+        static const char* const STATUS[] = { "exited", "limit", "failed" };
+
+        int failed = 0;
+        fprintf(out, "# job status exit_code insns host_ms checksum\n");
+        for (size_t i = 0; i < m_results.size(); ++i) {
+            const result& res = m_results[i];
+            fprintf(out, "%s %s %d %" PRIu64 " %.3f 0x%016" PRIx64 "\n",
+                    m_jobs[i].name.c_str(), STATUS[res.status], res.exit_code,
+                    res.insns, res.host_ms, res.checksum);
+            if (res.status != STATUS_EXITED || res.exit_code != 0)
+                failed++;
+        }
+
+        fprintf(out, "# %zu jobs, %d failed, %.3f s, %.0f jobs/hour\n",
+                m_results.size(), failed, m_secs,
+                m_secs > 0.0 ? m_results.size() * 3600.0 / m_secs : 0.0);
+        return failed;
+    }
+
+}
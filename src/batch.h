@@ -0,0 +1,114 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ocx/ocx.h"
+#include "memory.h"
+
+namespace ocx {
+
+    // Runs many independent simulations in one process. Every job gets its
+    // own memory, platform and cores and is run in deterministic mode on
+    // one thread of a fixed pool, so the core library is loaded only once
+    // and each image file is mapped only once for all jobs using it. The
+    // UART output of a job is written to <name>.out.
+    class batch
+    {
+    public:
+        typedef std::function<core*(env&)> create_fn;
+        typedef std::function<void(core*)> delete_fn;
+
+        enum : int {
+            STATUS_EXITED = 0, // guest wrote to PLATFORM_EXIT
+            STATUS_LIMIT,      // instruction limit reached
+            STATUS_FAILED,     // job could not be set up
+        };
+
+    private:
+        struct job {
+            std::string  name;
+            const image* img;
+            u64          limit;
+        };
+
+        struct region {
+            u64          addr;
+            u64          target;
+            u64          size;
+            const image* img;   // ROMs only
+        };
+
+        struct result {
+            int    status;
+            int    exit_code;
+            u64    insns;
+            double host_ms;
+            u64    checksum;
+        };
+
+        create_fn m_create;
+        delete_fn m_delete;
+        u64       m_memsize;
+        u64       m_ncores;
+        u64       m_quantum;
+        u64       m_quantum_ps;
+        u64       m_limit;
+
+        std::map<std::string, std::unique_ptr<image>> m_images;
+        std::vector<region> m_regions;
+        std::vector<job>    m_jobs;
+        std::vector<result> m_results;
+        std::atomic<size_t> m_next;
+        double              m_secs;
+
+        batch() = delete;
+        batch(const batch&) = delete;
+
+        const image* open_image(const char* path);
+        void run_job(const job& j, result& res);
+        void worker();
+
+    public:
+        batch(create_fn create, delete_fn destroy, u64 memsize, u64 ncores,
+              u64 quantum, u64 limit);
+        virtual ~batch();
+
+        inline size_t num_jobs() const { return m_jobs.size(); }
+
+        inline void set_time_quantum(u64 ps) { m_quantum_ps = ps; }
+
+        // regions mapped into the memory of every job; ROM images are
+        // shared by all jobs, returns false if path cannot be read
+        void add_alias(u64 addr, u64 target, u64 size);
+        bool add_rom(u64 addr, const char* path);
+
+        // reads one job per line: <name> <image> [<limit>]; empty lines and
+        // lines starting with # are skipped and the limit defaults to the
+        // one passed to the constructor; returns false on invalid lines
+        bool read_jobs(FILE* jobs);
+
+        // runs all jobs on nthreads threads and returns when all are done
+        void run(size_t nthreads);
+
+        // writes one line per job and returns the number of jobs that did
+        // not exit with code 0
+        int write_summary(FILE* out) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,361 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "bbv.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace ocx {
+
+    static const u32 NO_BLOCK = ~0u;
+
+    // dimensions of the random projection applied before clustering, as
+    // used by SimPoint
+    static const size_t BBV_DIMS = 15;
+
+    // SimPoint picks the smallest number of clusters whose BIC score
+    // reaches this fraction of the range of all scores
+    static const double BIC_THRESHOLD = 0.9;
+
+    static const int KMEANS_ITERATIONS = 100;
+
+    // lower bound of the cluster variance relative to the variance of all
+    // intervals
+    static const double MIN_VARIANCE = 1e-6;
+
+    static const double PI = 3.14159265358979323846;
+
+    static inline u64 mix(u64 x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    bbv::bbv(u64 length, const char* path) :
+        m_length(length),
+        m_start(~0ull),
+        m_last_insns(0),
+        m_last_id(NO_BLOCK),
+        m_file(nullptr),
+        m_table(1024, entry{ 0, NO_BLOCK }),
+        m_counts(),
+        m_touched(),
+        m_intervals() {
+        ERROR_ON(length == 0, "interval length must not be zero");
+        if (path != nullptr) {
+            m_file = fopen(path, "w");
+            ERROR_ON(m_file == nullptr, "unable to open %s: %s", path,
+                     strerror(errno));
+        }
+    }
+
+    bbv::~bbv() {
+        if (m_file != nullptr)
+            fclose(m_file);
+    }
+
+    u32 bbv::lookup(u64 vaddr) {
+        size_t mask = m_table.size() - 1;
+        for (size_t i = mix(vaddr) & mask;; i = (i + 1) & mask) {
+            entry& e = m_table[i];
+            if (e.id == NO_BLOCK) {
+                e.vaddr = vaddr;
+                e.id = (u32)m_counts.size();
+                m_counts.push_back(0);
+                if (m_counts.size() * 2 > m_table.size())
+                    grow();
+                return (u32)m_counts.size() - 1;
+            }
+
+            if (e.vaddr == vaddr)
+                return e.id;
+        }
+    }
+
+    void bbv::grow() {
+        std::vector<entry> old(m_table.size() * 2, entry{ 0, NO_BLOCK });
+        old.swap(m_table);
+
+        size_t mask = m_table.size() - 1;
+        for (auto& e : old) {
+            if (e.id == NO_BLOCK)
+                continue;
+
+            size_t i = mix(e.vaddr) & mask;
+            while (m_table[i].id != NO_BLOCK)
+                i = (i + 1) & mask;
+            m_table[i] = e;
+        }
+    }
+
+    void bbv::close_interval(u64 insns) {
+        interval iv;
+        iv.start = m_start;
+        iv.end = insns;
+
+        std::sort(m_touched.begin(), m_touched.end());
+        for (u32 id : m_touched) {
+            iv.counts.push_back(std::make_pair(id, m_counts[id]));
+            m_counts[id] = 0;
+        }
+
+        m_touched.clear();
+
+        if (m_file != nullptr) {
+            fprintf(m_file, "T");
+            for (auto& c : iv.counts)
+                fprintf(m_file, ":%u:%" PRIu64 " ", c.first + 1, c.second);
+            fprintf(m_file, "\n");
+        }
+
+        m_intervals.push_back(std::move(iv));
+        m_start = insns;
+    }
+
+    void bbv::begin_block(u64 vaddr, u64 insns) {
+        if (m_start == ~0ull)
+            m_start = insns;
+
+        // the instructions since the last block start belong to that block
+        if (m_last_id != NO_BLOCK && insns > m_last_insns) {
+            if (m_counts[m_last_id] == 0)
+                m_touched.push_back(m_last_id);
+            m_counts[m_last_id] += insns - m_last_insns;
+        }
+
+        if (insns - m_start >= m_length)
+            close_interval(insns);
+
+        m_last_insns = insns;
+        m_last_id = lookup(vaddr);
+    }
+
+    void bbv::finish(u64 insns) {
+        if (m_last_id != NO_BLOCK && insns > m_last_insns) {
+            if (m_counts[m_last_id] == 0)
+                m_touched.push_back(m_last_id);
+            m_counts[m_last_id] += insns - m_last_insns;
+        }
+
+        m_last_insns = insns;
+        if (!m_touched.empty())
+            close_interval(insns);
+    }
+
+    typedef std::vector<double> point;
+
+    static double distance2(const point& a, const point& b) {
+        double result = 0.0;
+        for (size_t d = 0; d < a.size(); ++d)
+            result += (a[d] - b[d]) * (a[d] - b[d]);
+        return result;
+    }
+
+    struct clustering {
+        std::vector<size_t> assign;
+        std::vector<point>  centers;
+        std::vector<size_t> sizes;
+        double              sse;
+    };
+
+    static clustering kmeans(const std::vector<point>& points, size_t k,
+                             std::mt19937_64& rng) {
+        size_t n = points.size();
+        clustering result;
+        result.assign.assign(n, 0);
+        result.sizes.assign(k, 0);
+
+        // k-means++ seeding
+        std::vector<double> dist(n, std::numeric_limits<double>::max());
+        result.centers.push_back(points[rng() % n]);
+        while (result.centers.size() < k) {
+            double total = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                dist[i] = std::min(dist[i], distance2(points[i],
+                                                      result.centers.back()));
+                total += dist[i];
+            }
+
+            size_t next = rng() % n;
+            if (total > 0.0) {
+                double r = std::uniform_real_distribution<double>(0.0,
+                                                                  total)(rng);
+                for (next = 0; next < n - 1 && r >= dist[next]; ++next)
+                    r -= dist[next];
+            }
+
+            result.centers.push_back(points[next]);
+        }
+
+        for (int iter = 0; iter < KMEANS_ITERATIONS; ++iter) {
+            bool changed = iter == 0;
+            for (size_t i = 0; i < n; ++i) {
+                size_t best = 0;
+                double best_dist = std::numeric_limits<double>::max();
+                for (size_t c = 0; c < k; ++c) {
+                    double d = distance2(points[i], result.centers[c]);
+                    if (d < best_dist) {
+                        best = c;
+                        best_dist = d;
+                    }
+                }
+
+                changed |= result.assign[i] != best;
+                result.assign[i] = best;
+            }
+
+            if (!changed)
+                break;
+
+            for (auto& center : result.centers)
+                std::fill(center.begin(), center.end(), 0.0);
+            std::fill(result.sizes.begin(), result.sizes.end(), 0);
+
+            for (size_t i = 0; i < n; ++i) {
+                point& center = result.centers[result.assign[i]];
+                for (size_t d = 0; d < center.size(); ++d)
+                    center[d] += points[i][d];
+                result.sizes[result.assign[i]]++;
+            }
+
+            for (size_t c = 0; c < k; ++c) {
+                for (auto& x : result.centers[c])
+                    x = result.sizes[c] ? x / result.sizes[c] : 0.0;
+            }
+        }
+
+        std::fill(result.sizes.begin(), result.sizes.end(), 0);
+        result.sse = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            result.sizes[result.assign[i]]++;
+            result.sse += distance2(points[i],
+                                    result.centers[result.assign[i]]);
+        }
+
+        return result;
+    }
+
+    // Bayesian information criterion as used by SimPoint (X-means); the
+    // variance is bounded from below, as otherwise clusterings that merely
+    // separate intervals with identical vectors get infinite likelihood
+    static double bic(const clustering& run, size_t n, size_t dims,
+                      double min_variance) {
+        size_t k = run.centers.size();
+        double variance = run.sse / (double)std::max<size_t>(n - k, 1);
+        variance = std::max(variance, min_variance);
+
+        double loglik = 0.0;
+        for (size_t c = 0; c < k; ++c) {
+            double nc = (double)run.sizes[c];
+            if (nc == 0.0)
+                continue;
+
+            loglik += nc * std::log(nc) - nc * std::log((double)n)
+                    - nc / 2.0 * std::log(2.0 * PI)
+                    - nc * dims / 2.0 * std::log(variance)
+                    - (nc - (double)k) / 2.0;
+        }
+
+        double params = (double)(k - 1) + (double)(dims * k) + 1.0;
+        return loglik - params / 2.0 * std::log((double)n);
+    }
+
+    std::vector<bbv::simpoint> bbv::cluster(size_t max_k, u64 seed) const {
+        std::vector<simpoint> result;
+        size_t n = m_intervals.size();
+        if (n == 0 || max_k == 0)
+            return result;
+
+        // normalize each vector and project it onto BBV_DIMS dimensions
+        // with a pseudo random matrix derived from the block ids
+        std::vector<point> points(n, point(BBV_DIMS, 0.0));
+        for (size_t i = 0; i < n; ++i) {
+            u64 total = 0;
+            for (auto& c : m_intervals[i].counts)
+                total += c.second;
+            if (total == 0)
+                continue;
+
+            for (auto& c : m_intervals[i].counts) {
+                double w = (double)c.second / (double)total;
+                for (size_t d = 0; d < BBV_DIMS; ++d) {
+                    u64 h = mix(seed ^ mix(((u64)c.first << 8) | d));
+                    double r = (double)(h >> 11) / (double)(1ull << 53);
+                    points[i][d] += w * (2.0 * r - 1.0);
+                }
+            }
+        }
+
+        std::mt19937_64 rng(seed);
+        std::vector<clustering> runs;
+        for (size_t k = 1; k <= std::min(max_k, n); ++k)
+            runs.push_back(kmeans(points, k, rng));
+
+        double min_variance = std::max(MIN_VARIANCE * runs[0].sse / n, 1e-30);
+        std::vector<double> scores;
+        for (auto& run : runs)
+            scores.push_back(bic(run, n, BBV_DIMS, min_variance));
+
+        double min_bic = *std::min_element(scores.begin(), scores.end());
+        double max_bic = *std::max_element(scores.begin(), scores.end());
+
+        const clustering* best = &runs.back();
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (scores[i] >= min_bic + BIC_THRESHOLD * (max_bic - min_bic)) {
+                best = &runs[i];
+                break;
+            }
+        }
+
+        // intervals differ in length, so weigh clusters by instructions
+        u64 total = 0;
+        std::vector<u64> insns(best->centers.size(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            u64 len = m_intervals[i].end - m_intervals[i].start;
+            insns[best->assign[i]] += len;
+            total += len;
+        }
+
+        for (size_t c = 0; c < best->centers.size(); ++c) {
+            if (best->sizes[c] == 0)
+                continue;
+
+            size_t closest = 0;
+            double closest_dist = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < n; ++i) {
+                if (best->assign[i] != c)
+                    continue;
+
+                double d = distance2(points[i], best->centers[c]);
+                if (d < closest_dist) {
+                    closest = i;
+                    closest_dist = d;
+                }
+            }
+
+            simpoint sp;
+            sp.interval = closest;
+            sp.start = m_intervals[closest].start;
+            sp.end = m_intervals[closest].end;
+            sp.cluster = result.size();
+            sp.weight = total ? (double)insns[c] / (double)total : 0.0;
+            result.push_back(sp);
+        }
+
+        return result;
+    }
+
+}
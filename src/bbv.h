@@ -0,0 +1,89 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef BBV_H
+#define BBV_H
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "ocx/ocx.h"
+
+namespace ocx {
+
+    // Collects SimPoint style basic block vectors of one core. For every
+    // interval of a fixed number of instructions, the vector holds the
+    // number of instructions executed in each basic block. Block sizes are
+    // derived from the instruction count at consecutive block starts, so
+    // intervals end at the first block boundary after the interval length.
+    class bbv
+    {
+    public:
+        struct interval {
+            u64 start;
+            u64 end;
+            std::vector<std::pair<u32, u64>> counts; // block id, insns
+        };
+
+        struct simpoint {
+            size_t interval;
+            u64    start;
+            u64    end;
+            size_t cluster;
+            double weight;
+        };
+
+    private:
+        struct entry {
+            u64 vaddr;
+            u32 id;
+        };
+
+        u64 m_length;
+        u64 m_start;
+        u64 m_last_insns;
+        u32 m_last_id;
+        FILE* m_file;
+
+        std::vector<entry> m_table; // open addressing, vaddr -> block id
+        std::vector<u64>   m_counts;
+        std::vector<u32>   m_touched;
+        std::vector<interval> m_intervals;
+
+        bbv() = delete;
+        bbv(const bbv&) = delete;
+
+        u32 lookup(u64 vaddr);
+        void grow();
+        void close_interval(u64 insns);
+
+    public:
+        // writes intervals to path in SimPoint .bb format unless null
+        bbv(u64 length, const char* path);
+        virtual ~bbv();
+
+        inline size_t num_blocks() const { return m_counts.size(); }
+        inline const std::vector<interval>& intervals() const {
+            return m_intervals;
+        }
+
+        // called at the start of every basic block with the instruction
+        // count of the core at that time
+        void begin_block(u64 vaddr, u64 insns);
+
+        // closes the last, partial interval
+        void finish(u64 insns);
+
+        // clusters the intervals into at most max_k phases and returns the
+        // interval closest to the center of each phase and its weight
+        std::vector<simpoint> cluster(size_t max_k, u64 seed = 1) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,223 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "blockdev.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace ocx {
+
+    blockdev::blockdev(platform& p, u64 base, u64 irq, const char* image,
+                       bool overlay) :
+        device(base, REG_SIZE),
+        m_platform(p),
+        m_irq(irq),
+        m_image(nullptr),
+        m_image_size(0),
+        m_thread(),
+        m_mtx(),
+        m_cv(),
+        m_queue(),
+        m_quit(false),
+        m_completed(0),
+        m_num_reads(0),
+        m_num_writes(0),
+        m_num_bytes(0),
+        m_first(),
+        m_last() {
+#ifdef WIN32
+        (void)image;
+        (void)overlay;
+        ERROR("block device not supported on Windows");
+#else
+        int fd = open(image, overlay ? O_RDONLY : O_RDWR);
+        ERROR_ON(fd < 0, "unable to open %s: %s", image, strerror(errno));
+
+        struct stat st;
+        ERROR_ON(fstat(fd, &st) != 0, "unable to stat %s: %s", image,
+                 strerror(errno));
+        ERROR_ON(st.st_size <= 0 || st.st_size % SECTOR_SIZE != 0,
+                 "size of %s is not a multiple of %d bytes", image,
+                 (int)SECTOR_SIZE);
+
+        const int p_flags = PROT_READ | PROT_WRITE;
+        const int m_flags = overlay ? MAP_PRIVATE | MAP_NORESERVE
+                                    : MAP_SHARED;
+        void* map = mmap(NULL, st.st_size, p_flags, m_flags, fd, 0);
+        ERROR_ON(map == MAP_FAILED, "unable to map %s: %s", image,
+                 strerror(errno));
+        close(fd);
+
+        m_image = (u8*)map;
+        m_image_size = st.st_size;
+        m_thread = std::thread(&blockdev::io_thread, this);
+#endif
+    }
+
+    blockdev::~blockdev() {
+        if (m_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_quit = true;
+            }
+            m_cv.notify_one();
+            m_thread.join();
+        }
+
+#ifndef WIN32
+        if (m_image != nullptr)
+            munmap(m_image, m_image_size);
+#endif
+    }
+
+    u32 blockdev::process(descriptor& desc) {
+        memory& mem = m_platform.get_memory();
+        u64 capacity = m_image_size / SECTOR_SIZE;
+
+        switch (desc.op) {
+        case OP_READ:
+        case OP_WRITE: {
+            if (desc.sector > capacity || desc.count > capacity - desc.sector)
+                return STATUS_IOERR;
+
+            u64 len = desc.count * SECTOR_SIZE;
+            if (desc.buffer > mem.get_size() ||
+                len > mem.get_size() - desc.buffer)
+                return STATUS_IOERR;
+
+            u8* disk = m_image + desc.sector * SECTOR_SIZE;
+            u8* host = mem.get_ptr() + desc.buffer;
+            if (desc.op == OP_READ) {
+                memcpy(host, disk, len);
+                if (len > 0)
+                    m_platform.flush_code(desc.buffer, desc.buffer + len - 1);
+                m_num_reads++;
+            } else {
+                memcpy(disk, host, len);
+                m_num_writes++;
+            }
+
+            m_num_bytes += len;
+            return STATUS_OK;
+        }
+
+        case OP_FLUSH:
+#ifndef WIN32
+            if (msync(m_image, m_image_size, MS_SYNC) != 0)
+                return STATUS_IOERR;
+#endif
+            return STATUS_OK;
+
+        default:
+            return STATUS_UNSUPP;
+        }
+    }
+
+    void blockdev::io_thread() {
+        memory& mem = m_platform.get_memory();
+        std::unique_lock<std::mutex> lock(m_mtx);
+        for (;;) {
+            m_cv.wait(lock, [this]() { return m_quit || !m_queue.empty(); });
+            if (m_quit)
+                return;
+
+            u64 addr = m_queue.front();
+            m_queue.pop_front();
+            lock.unlock();
+
+            auto now = std::chrono::steady_clock::now();
+            if (m_num_reads + m_num_writes == 0)
+                m_first = now;
+
+            if (addr <= mem.get_size() &&
+                sizeof(descriptor) <= mem.get_size() - addr) {
+                descriptor desc;
+                u8* ptr = mem.get_ptr() + addr;
+                memcpy(&desc, ptr, sizeof(desc));
+                desc.status = process(desc);
+                memcpy(ptr + offsetof(descriptor, status), &desc.status,
+                       sizeof(desc.status));
+            }
+
+            m_last = std::chrono::steady_clock::now();
+
+            lock.lock();
+            m_completed++;
+            m_platform.raise_irq(0, m_irq, true);
+        }
+    }
+
+    response blockdev::transport(u64 coreid, u64 offset,
+                                 const transaction& tx) {
+        (void)coreid;
+
+        if ((tx.size != 4 && tx.size != 8) || (offset & 7))
+            return RESP_FAILED;
+
+        u64 val = 0;
+        if (!tx.is_read)
+            memcpy(&val, tx.data, tx.size);
+
+        std::lock_guard<std::mutex> lock(m_mtx);
+        switch (offset) {
+        case REG_DESC:
+            if (tx.is_read)
+                return RESP_COMMAND_ERROR;
+            m_queue.push_back(val);
+            m_cv.notify_one();
+            return RESP_OK;
+
+        case REG_STATUS:
+            if (tx.is_read) {
+                val = m_completed;
+                break;
+            }
+
+            m_completed -= std::min<u64>(val, m_completed);
+            if (m_completed == 0)
+                m_platform.raise_irq(0, m_irq, false);
+            return RESP_OK;
+
+        case REG_CAPACITY:
+            if (!tx.is_read)
+                return RESP_COMMAND_ERROR;
+            val = m_image_size / SECTOR_SIZE;
+            break;
+
+        default:
+            return RESP_ADDRESS_ERROR;
+        }
+
+        memcpy(tx.data, &val, tx.size);
+        return RESP_OK;
+    }
+
+    void blockdev::report() {
+        u64 reads = m_num_reads;
+        u64 writes = m_num_writes;
+        double secs = std::chrono::duration<double>(m_last - m_first).count();
+        double mib = m_num_bytes / (1024.0 * 1024.0);
+        printf("Block device: %" PRIu64 " reads, %" PRIu64 " writes, "
+               "%.1f MiB", reads, writes, mib);
+        if (secs > 0.0)
+            printf(", %.0f IOPS, %.1f MiB/s", (reads + writes) / secs,
+                   mib / secs);
+        printf("\n");
+    }
+
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "ocx/ocx.h"
+#include "device.h"
+#include "platform.h"
+
+namespace ocx {
+
+    // Simple DMA block device backed by a memory mapped disk image. The guest
+    // writes the physical address of a descriptor to REG_DESC, the request is
+    // then processed on a separate I/O thread, which copies data directly
+    // between the image mapping and guest memory, stores the result in the
+    // descriptor status and raises the completion interrupt on core 0. With
+    // an overlay, the image is mapped copy-on-write and never modified.
+    class blockdev : public device
+    {
+    public:
+        enum : u64 {
+            REG_DESC     = 0x00, // w: descriptor address, starts request
+            REG_STATUS   = 0x08, // r: completions pending, w: acknowledge
+            REG_CAPACITY = 0x10, // r: disk size in sectors
+            REG_SIZE     = 0x18,
+        };
+
+        enum : u32 {
+            OP_READ  = 0,
+            OP_WRITE = 1,
+            OP_FLUSH = 2,
+        };
+
+        enum : u32 {
+            STATUS_OK      = 0,
+            STATUS_IOERR   = 1,
+            STATUS_UNSUPP  = 2,
+        };
+
+        enum : u64 {
+            SECTOR_SIZE = 512,
+        };
+
+        struct descriptor {
+            u32 op;
+            u32 status;
+            u64 sector;
+            u64 count;
+            u64 buffer;
+        };
+
+    private:
+        platform& m_platform;
+        u64       m_irq;
+        u8*       m_image;
+        u64       m_image_size;
+
+        std::thread             m_thread;
+        std::mutex              m_mtx;
+        std::condition_variable m_cv;
+        std::deque<u64>         m_queue;
+        bool                    m_quit;
+        std::atomic<u64>        m_completed;
+
+        std::atomic<u64> m_num_reads;
+        std::atomic<u64> m_num_writes;
+        std::atomic<u64> m_num_bytes;
+        std::chrono::steady_clock::time_point m_first;
+        std::chrono::steady_clock::time_point m_last;
+
+        blockdev() = delete;
+        blockdev(const blockdev&) = delete;
+
+        u32 process(descriptor& desc);
+        void io_thread();
+
+    public:
+        blockdev(platform& p, u64 base, u64 irq, const char* image,
+                 bool overlay);
+        virtual ~blockdev();
+
+        virtual response transport(u64 coreid, u64 offset,
+                                   const transaction& tx) override;
+
+        virtual void report() override;
+    };
+
+}
+
+#endif
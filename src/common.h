@@ -11,17 +11,41 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#define INFO(...)                                                             \
+#include "log.h"
+
+// log levels, messages below OCX_LOG_LEVEL are compiled out; errors are
+// always reported
+#define OCX_LOG_INFO  0
+#define OCX_LOG_ERROR 1
+
+#ifndef OCX_LOG_LEVEL
+#define OCX_LOG_LEVEL OCX_LOG_INFO
+#endif
+
+// the dead printf call keeps the compiler's format string checks, since
+// the arguments are only formatted later on by the logging thread
+#define OCX_LOG(...)                                                          \
     do {                                                                      \
-        fprintf(stderr, "%s:%d ", __FILE__, __LINE__);                        \
-        fprintf(stderr, __VA_ARGS__);                                         \
-        fprintf(stderr, "\n");                                                \
+        if (0)                                                                \
+            printf(__VA_ARGS__);                                              \
+        ocx::log_message(__FILE__, __LINE__, __VA_ARGS__);                    \
     } while (0)
 
+#if OCX_LOG_LEVEL <= OCX_LOG_INFO
+#define INFO(...) OCX_LOG(__VA_ARGS__)
+#else
+#define INFO(...)                                                             \
+    do {                                                                      \
+        if (0)                                                                \
+            printf(__VA_ARGS__);                                              \
+    } while (0)
+#endif
 
+// errors are written out synchronously, so they are not lost on abort
 #define ERROR(...)                                                            \
     do {                                                                      \
-        INFO(__VA_ARGS__);                                                    \
+        OCX_LOG(__VA_ARGS__);                                                 \
+        ocx::log_flush();                                                     \
         abort();                                                              \
     } while (0)
 
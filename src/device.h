@@ -0,0 +1,47 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include "ocx/ocx.h"
+
+namespace ocx {
+
+    // memory mapped device of the runner platform; transport receives
+    // transactions with addresses relative to the start of the device
+    class device
+    {
+    private:
+        u64 m_base;
+        u64 m_size;
+
+        device() = delete;
+        device(const device&) = delete;
+
+    public:
+        device(u64 base, u64 size): m_base(base), m_size(size) {}
+        virtual ~device() {}
+
+        inline u64 get_base() const { return m_base; }
+        inline u64 get_size() const { return m_size; }
+
+        inline bool contains(u64 addr, u64 size) const {
+            return addr >= m_base && size <= m_size &&
+                   addr - m_base <= m_size - size;
+        }
+
+        virtual response transport(u64 coreid, u64 offset,
+                                   const transaction& tx) = 0;
+
+        // prints device statistics at the end of the simulation
+        virtual void report() {}
+    };
+
+}
+
+#endif
@@ -7,7 +7,11 @@
 
 #include <iostream>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cstring>
+#include <algorithm>
 
 #define OCX_DLL_EXPORT
 
@@ -18,17 +22,39 @@ namespace ocx {
     class dummycore:
         public core,
         public core_inv_range_extension,
-        public core_trace_insns_extension
+        public core_trace_insns_extension,
+        public core_async_step_extension,
+        public core_step_time_extension
     {
     public:
         dummycore(env& e):
             core(),
-            m_num_insn(),
-            m_env(e) {
+            m_num_insn(0),
+            m_env(e),
+            m_env_trace(nullptr),
+            m_env_async(nullptr),
+            m_async_thread(),
+            m_async_mtx(),
+            m_async_cv(),
+            m_async_req(0),
+            m_async_result(0),
+            m_async_busy(false),
+            m_async_done(false),
+            m_async_quit(false) {
+            using trace_ext = env_trace_insns_extension;
+            m_env_trace = ocx::query_extension<trace_ext>(m_env);
+            m_env_async = ocx::query_extension<env_async_step_extension>(m_env);
         }
 
         virtual ~dummycore() {
-            return;
+            if (m_async_thread.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(m_async_mtx);
+                    m_async_quit = true;
+                }
+                m_async_cv.notify_one();
+                m_async_thread.join();
+            }
         }
 
         virtual const char* provider() override {
@@ -191,15 +217,105 @@ namespace ocx {
             return;
         }
 
+        virtual void* query_extension(u64 id) override {
+            switch (id) {
+            case core_inv_range_extension::ID:
+                return static_cast<core_inv_range_extension*>(this);
+            case core_trace_insns_extension::ID:
+                return static_cast<core_trace_insns_extension*>(this);
+            case core_async_step_extension::ID:
+                return static_cast<core_async_step_extension*>(this);
+            case core_step_time_extension::ID:
+                return static_cast<core_step_time_extension*>(this);
+            default:
+                return nullptr;
+            }
+        }
+
         virtual bool trace_insns(bool on) override {
             (void)on;
-            auto env_ext = dynamic_cast<env_trace_insns_extension*>(&m_env);
-            return env_ext != nullptr;
+            return m_env_trace != nullptr;
+        }
+
+        virtual bool step_async(u64 num_insn) override {
+            std::lock_guard<std::mutex> lock(m_async_mtx);
+            if (m_async_busy || m_async_done)
+                return false;
+
+            if (!m_async_thread.joinable())
+                m_async_thread = std::thread(&dummycore::async_worker, this);
+
+            m_async_req = num_insn;
+            m_async_busy = true;
+            m_async_cv.notify_one();
+            return true;
+        }
+
+        virtual bool step_poll(u64& num_insn) override {
+            std::lock_guard<std::mutex> lock(m_async_mtx);
+            if (!m_async_done)
+                return false;
+
+            m_async_done = false;
+            num_insn = m_async_result;
+            return true;
+        }
+
+        // the dummy runs at a fixed clock of one instruction per cycle and
+        // always executes at least one instruction
+        virtual u64 step_time(u64 budget_ps, u64 max_insn,
+                              u64& used_ps) override {
+            u64 num = std::max<u64>(budget_ps / CLOCK_PERIOD_PS, 1);
+            if (max_insn != 0 && max_insn < num)
+                num = max_insn;
+
+            num = step(num);
+            used_ps = num * CLOCK_PERIOD_PS;
+            return num;
         }
 
     private:
-        u64 m_num_insn;
+        enum : u64 { CLOCK_PERIOD_PS = 1000 }; // 1 GHz
+
+        std::atomic<u64> m_num_insn;
         env& m_env;
+        env_trace_insns_extension* m_env_trace;
+        env_async_step_extension* m_env_async;
+
+        std::thread m_async_thread;
+        std::mutex m_async_mtx;
+        std::condition_variable m_async_cv;
+        u64 m_async_req;
+        u64 m_async_result;
+        bool m_async_busy;
+        bool m_async_done;
+        bool m_async_quit;
+
+        void async_worker() {
+            std::unique_lock<std::mutex> lock(m_async_mtx);
+            for (;;) {
+                m_async_cv.wait(lock, [this]() {
+                    return m_async_quit || m_async_busy;
+                });
+
+                if (m_async_quit)
+                    return;
+
+                lock.unlock();
+                u64 result = step(m_async_req);
+                lock.lock();
+
+                m_async_result = result;
+                m_async_busy = false;
+                m_async_done = true;
+
+                if (m_env_async != nullptr) {
+                    lock.unlock();
+                    m_env_async->step_complete(result);
+                    lock.lock();
+                }
+            }
+        }
     };
 
     core* create_instance(u64 api_version, env& e, const char* variant) {
@@ -0,0 +1,174 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "forkserver.h"
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <chrono>
+
+namespace ocx {
+
+    forkserver::forkserver(platform& p, u64 quantum, u64 input_addr,
+                           u64 limit) :
+        m_platform(p),
+        m_quantum(quantum),
+        m_input_addr(input_addr),
+        m_limit(limit) {
+    }
+
+    forkserver::~forkserver() {
+    }
+
+    void forkserver::boot(u64 insns) {
+        auto start = std::chrono::steady_clock::now();
+        m_platform.run(m_quantum, insns);
+        auto end = std::chrono::steady_clock::now();
+
+        ERROR_ON(m_platform.exited(), "guest exited with code %d during boot",
+                 m_platform.exit_code());
+        ERROR_ON(insns == 0 && !m_platform.marker_seen(),
+                 "boot finished without reaching the marker");
+
+        double ms = std::chrono::duration<double, std::milli>(end - start)
+                    .count();
+        printf("Boot finished after %" PRIu64 " instructions (%.3f ms)\n",
+               m_platform.get_core(0)->insn_count(), ms);
+    }
+
+#ifdef WIN32
+
+    void forkserver::run_child(const char* input, int fd) {
+        (void)input;
+        (void)fd;
+        ERROR("fork server not supported on Windows");
+    }
+
+    bool forkserver::run_case(const char* input, result& res) {
+        (void)input;
+        (void)res;
+        ERROR("fork server not supported on Windows");
+    }
+
+#else
+
+    void forkserver::run_child(const char* input, int fd) {
+        auto start = std::chrono::steady_clock::now();
+
+        u64 size = m_platform.get_memory().load(input, m_input_addr);
+        if (size > 0)
+            m_platform.flush_code(m_input_addr, m_input_addr + size - 1);
+
+        u64 insns_start = 0;
+        for (size_t i = 0; i < m_platform.num_cores(); ++i)
+            insns_start += m_platform.get_core(i)->insn_count();
+
+        m_platform.run(m_quantum, m_limit);
+
+        u64 insns_end = 0;
+        for (size_t i = 0; i < m_platform.num_cores(); ++i)
+            insns_end += m_platform.get_core(i)->insn_count();
+
+        auto end = std::chrono::steady_clock::now();
+
+        result res;
+        res.status = m_platform.exited() ? STATUS_EXITED : STATUS_LIMIT;
+        res.exit_code = m_platform.exit_code();
+        res.insns = insns_end - insns_start;
+        res.host_ms = std::chrono::duration<double, std::milli>(end - start)
+                      .count();
+
+        ssize_t n = write(fd, &res, sizeof(res));
+        close(fd);
+        log_flush();
+        _exit(n == sizeof(res) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    bool forkserver::run_case(const char* input, result& res) {
+        int fds[2];
+        ERROR_ON(pipe(fds) != 0, "pipe failed: %s", strerror(errno));
+
+        // do not let children flush output buffered by the server
+        fflush(stdout);
+        fflush(stderr);
+
+        pid_t pid = fork();
+        ERROR_ON(pid < 0, "fork failed: %s", strerror(errno));
+
+        if (pid == 0) {
+            close(fds[0]);
+            run_child(input, fds[1]);
+        }
+
+        close(fds[1]);
+        ssize_t n = read(fds[0], &res, sizeof(res));
+        close(fds[0]);
+
+        int wstatus = 0;
+        ERROR_ON(waitpid(pid, &wstatus, 0) != pid, "waitpid failed: %s",
+                 strerror(errno));
+
+        if (n != sizeof(res) || !WIFEXITED(wstatus) ||
+            WEXITSTATUS(wstatus) != EXIT_SUCCESS) {
+            res.status = STATUS_CRASHED;
+            res.exit_code = WIFSIGNALED(wstatus) ? WTERMSIG(wstatus) : -1;
+            res.insns = 0;
+            res.host_ms = 0.0;
+            return false;
+        }
+
+        return true;
+    }
+
+#endif
+
+    int forkserver::serve(FILE* cases) {
+        int failed = 0;
+        char line[4096];
+        while (fgets(line, sizeof(line), cases) != nullptr) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0')
+                continue;
+
+            result res;
+            run_case(line, res);
+
+            switch (res.status) {
+            case STATUS_EXITED:
+                printf("%s: exit %d after %" PRIu64 " instructions "
+                       "(%.3f ms)\n", line, res.exit_code, res.insns,
+                       res.host_ms);
+                if (res.exit_code != 0)
+                    failed++;
+                break;
+
+            case STATUS_LIMIT:
+                printf("%s: limit reached after %" PRIu64 " instructions "
+                       "(%.3f ms)\n", line, res.insns, res.host_ms);
+                failed++;
+                break;
+
+            default:
+                printf("%s: crashed (signal %d)\n", line, res.exit_code);
+                failed++;
+                break;
+            }
+
+            fflush(stdout);
+        }
+
+        return failed;
+    }
+
+}
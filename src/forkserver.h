@@ -0,0 +1,64 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include <cstdio>
+
+#include "ocx/ocx.h"
+#include "platform.h"
+
+namespace ocx {
+
+    // The fork server boots the platform once and then runs every test case
+    // in a forked copy-on-write child. Children inherit guest memory as well
+    // as all core library state, inject their input into guest memory, run
+    // and report their result back to the server over a pipe.
+    class forkserver
+    {
+    private:
+        struct result {
+            int status;
+            int exit_code;
+            u64 insns;
+            double host_ms;
+        };
+
+        platform& m_platform;
+        u64       m_quantum;
+        u64       m_input_addr;
+        u64       m_limit;
+
+        forkserver() = delete;
+        forkserver(const forkserver&) = delete;
+
+        void run_child(const char* input, int fd);
+        bool run_case(const char* input, result& res);
+
+    public:
+        enum : int {
+            STATUS_EXITED = 0, // guest wrote to PLATFORM_EXIT
+            STATUS_LIMIT,      // instruction limit reached
+            STATUS_CRASHED,    // child process died
+        };
+
+        forkserver(platform& p, u64 quantum, u64 input_addr, u64 limit);
+        virtual ~forkserver();
+
+        // runs until the guest writes PLATFORM_MARKER or, if insns is not
+        // zero, until each core has executed insns instructions
+        void boot(u64 insns);
+
+        // reads one input file path per line and runs each in a new child;
+        // returns the number of test cases that did not exit cleanly
+        int serve(FILE* cases);
+    };
+
+}
+
+#endif
@@ -0,0 +1,321 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "log.h"
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ocx {
+
+    enum : size_t {
+        LOG_RING_SIZE   = 64 * 1024,
+        LOG_OUTPUT_SIZE = 16 * 1024,
+    };
+
+    // single producer, single consumer ring of log records; positions are
+    // byte offsets that only ever grow, records never wrap around the end
+    // of the buffer, a record with a null format function marks the skip
+    // to the start of the buffer
+    struct log_ring {
+        std::atomic<u64>  head;
+        char              pad0[56];
+        std::atomic<u64>  tail;
+        char              pad1[56];
+        std::atomic<bool> retired;
+        alignas(LOG_ALIGN) char data[LOG_RING_SIZE];
+
+        log_ring() : head(0), tail(0), retired(false) {}
+
+        inline log_record* at(u64 pos) {
+            return (log_record*)(data + pos % LOG_RING_SIZE);
+        }
+    };
+
+    class logger
+    {
+    private:
+        std::mutex              m_mtx; // consumer side and ring list
+        std::vector<log_ring*>  m_rings;
+        std::atomic<u64>        m_seq;
+        std::atomic<bool>       m_running;
+        std::atomic<bool>       m_quit;
+        std::mutex              m_wake_mtx;
+        std::condition_variable m_wake_cv;
+        std::unique_ptr<std::thread> m_thread;
+        char                    m_out[LOG_OUTPUT_SIZE];
+        size_t                  m_out_len;
+
+        void output(const log_record* rec);
+        void drain();
+        void flusher();
+
+        static void at_exit();
+#ifndef WIN32
+        static void at_fork_prepare();
+        static void at_fork_parent();
+        static void at_fork_child();
+#endif
+
+    public:
+        logger();
+        ~logger() = delete;
+
+        log_ring* create_ring();
+        void submit(log_ring* ring, log_record* rec);
+        void flush();
+
+        static logger& get();
+    };
+
+    // marks the ring of an exiting thread, so that the flusher frees it
+    // once all its messages have been written
+    struct log_ring_owner {
+        log_ring* ring = nullptr;
+
+        ~log_ring_owner() {
+            if (ring != nullptr)
+                ring->retired = true;
+        }
+    };
+
+    static thread_local log_ring_owner t_ring;
+
+    logger::logger() :
+        m_mtx(),
+        m_rings(),
+        m_seq(0),
+        m_running(false),
+        m_quit(false),
+        m_wake_mtx(),
+        m_wake_cv(),
+        m_thread(),
+        m_out(),
+        m_out_len(0) {
+        atexit(&logger::at_exit);
+#ifndef WIN32
+        pthread_atfork(&logger::at_fork_prepare, &logger::at_fork_parent,
+                       &logger::at_fork_child);
+#endif
+    }
+
+    logger& logger::get() {
+        // never destroyed, threads may still log during static destruction
+        static logger* instance = new logger();
+        return *instance;
+    }
+
+    log_ring* logger::create_ring() {
+        log_ring* ring = new log_ring();
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_rings.push_back(ring);
+
+        if (!m_running && !m_quit) {
+            m_running = true;
+            m_thread.reset(new std::thread(&logger::flusher, this));
+        }
+
+        return ring;
+    }
+
+    void logger::submit(log_ring* ring, log_record* rec) {
+        rec->seq = m_seq++;
+
+        for (;;) {
+            u64 head = ring->head.load(std::memory_order_acquire);
+            u64 tail = ring->tail.load(std::memory_order_relaxed);
+            u64 skip = LOG_RING_SIZE - tail % LOG_RING_SIZE;
+            if (skip >= rec->size)
+                skip = 0;
+
+            if (tail + skip + rec->size - head <= LOG_RING_SIZE) {
+                if (skip > 0) {
+                    log_record* marker = ring->at(tail);
+                    marker->size = (u32)skip;
+                    marker->format = nullptr;
+                }
+
+                memcpy(ring->at(tail + skip), rec, rec->size);
+                ring->tail.store(tail + skip + rec->size,
+                                 std::memory_order_release);
+                break;
+            }
+
+            // ring is full, make room by writing out messages ourselves
+            flush();
+        }
+
+        if (!m_running)
+            flush();
+        else if (ring->tail - ring->head > LOG_RING_SIZE / 2)
+            m_wake_cv.notify_one();
+    }
+
+    void logger::output(const log_record* rec) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            char* buf = m_out + m_out_len;
+            size_t size = LOG_OUTPUT_SIZE - m_out_len;
+            int n = snprintf(buf, size, "%s:%u ", rec->file, rec->line);
+            if (n >= 0 && (size_t)n < size) {
+                int m = rec->format(buf + n, size - n, rec);
+                if (m > 0)
+                    n += m;
+            }
+
+            // a message must end with a newline and fit into the buffer,
+            // otherwise we write out what we have and try again once
+            if (n >= 0 && (size_t)n + 1 < size) {
+                buf[n] = '\n';
+                m_out_len += n + 1;
+                return;
+            }
+
+            if (m_out_len == 0) {
+                m_out[LOG_OUTPUT_SIZE - 2] = '\n';
+                m_out_len = LOG_OUTPUT_SIZE - 1;
+                return;
+            }
+
+            fwrite(m_out, 1, m_out_len, stderr);
+            m_out_len = 0;
+        }
+    }
+
+    void logger::drain() {
+        // merge the rings in submission order
+        for (;;) {
+            log_ring* next = nullptr;
+            log_record* next_rec = nullptr;
+            for (auto ring : m_rings) {
+                u64 head = ring->head.load(std::memory_order_relaxed);
+                u64 tail = ring->tail.load(std::memory_order_acquire);
+                if (head == tail)
+                    continue;
+
+                log_record* rec = ring->at(head);
+                if (rec->format == nullptr) {
+                    head += rec->size;
+                    ring->head.store(head, std::memory_order_release);
+                    if (head == tail)
+                        continue;
+                    rec = ring->at(head);
+                }
+
+                if (next_rec == nullptr || rec->seq < next_rec->seq) {
+                    next = ring;
+                    next_rec = rec;
+                }
+            }
+
+            if (next == nullptr)
+                break;
+
+            output(next_rec);
+            next->head.store(next->head + next_rec->size,
+                             std::memory_order_release);
+        }
+
+        if (m_out_len > 0) {
+            fwrite(m_out, 1, m_out_len, stderr);
+            fflush(stderr);
+            m_out_len = 0;
+        }
+
+        for (size_t i = 0; i < m_rings.size();) {
+            log_ring* ring = m_rings[i];
+            if (ring->retired && ring->head == ring->tail) {
+                m_rings[i] = m_rings.back();
+                m_rings.pop_back();
+                delete ring;
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    void logger::flush() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        drain();
+    }
+
+    void logger::flusher() {
+        std::unique_lock<std::mutex> lock(m_wake_mtx);
+        while (!m_quit) {
+            m_wake_cv.wait_for(lock, std::chrono::milliseconds(10));
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    void logger::at_exit() {
+        logger& log = get();
+        {
+            std::lock_guard<std::mutex> lock(log.m_wake_mtx);
+            log.m_quit = true;
+        }
+
+        log.m_wake_cv.notify_one();
+        if (log.m_thread != nullptr)
+            log.m_thread->join();
+
+        log.m_running = false;
+        log.flush();
+    }
+
+#ifndef WIN32
+
+    void logger::at_fork_prepare() {
+        logger& log = get();
+        log.m_mtx.lock();
+        log.drain();
+    }
+
+    void logger::at_fork_parent() {
+        get().m_mtx.unlock();
+    }
+
+    void logger::at_fork_child() {
+        // only the forking thread survives, its messages are written out
+        // synchronously from now on
+        logger& log = get();
+        for (auto ring : log.m_rings) {
+            if (ring != t_ring.ring)
+                ring->retired = true;
+        }
+
+        // the flusher thread does not exist in the child, so its handle is
+        // leaked rather than destroyed while joinable
+        log.m_thread.release();
+        log.m_running = false;
+        log.m_quit = true;
+        log.m_mtx.unlock();
+    }
+
+#endif
+
+    void log_submit(log_record* rec) {
+        logger& log = logger::get();
+        if (t_ring.ring == nullptr)
+            t_ring.ring = log.create_ring();
+        log.submit(t_ring.ring, rec);
+    }
+
+    void log_flush() {
+        logger::get().flush();
+    }
+
+}
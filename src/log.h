@@ -0,0 +1,150 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "ocx/ocx.h"
+
+namespace ocx {
+
+    // Messages are not formatted by the logging thread. Instead, the format
+    // string and the arguments are stored in a per-thread ring buffer and
+    // formatted by a background thread. String arguments are copied into
+    // the record, all other arguments must be trivially copyable.
+
+    typedef int (*log_format_fn)(char* buf, size_t size, const void* rec);
+
+    struct log_record {
+        u32           size;
+        u32           line;
+        log_format_fn format;
+        const char*   file;
+        const char*   fmt;
+        u64           seq;
+    };
+
+    struct log_str {
+        u32 offset;
+    };
+
+    enum : size_t {
+        LOG_MAX_RECORD = 1024, // longer string arguments are truncated
+        LOG_ALIGN      = 16,
+    };
+
+    // copies rec into the ring buffer of the calling thread
+    void log_submit(log_record* rec);
+
+    // formats and writes all pending messages of all threads
+    void log_flush();
+
+    template <class T>
+    inline T log_pack(T val, char* rec, size_t& used) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "log arguments must be trivially copyable");
+        (void)rec;
+        (void)used;
+        return val;
+    }
+
+    inline log_str log_pack(const char* s, char* rec, size_t& used) {
+        if (s == nullptr)
+            s = "(null)";
+
+        // once the record is full, refer to the terminator of the last one
+        if (used >= LOG_MAX_RECORD) {
+            log_str empty = { (u32)(LOG_MAX_RECORD - 1) };
+            return empty;
+        }
+
+        size_t len = strnlen(s, LOG_MAX_RECORD - used - 1);
+        log_str result = { (u32)used };
+        memcpy(rec + used, s, len);
+        rec[used + len] = '\0';
+        used += len + 1;
+        return result;
+    }
+
+    inline log_str log_pack(char* s, char* rec, size_t& used) {
+        return log_pack((const char*)s, rec, used);
+    }
+
+    template <class T>
+    inline T log_unpack(T val, const char* rec) {
+        (void)rec;
+        return val;
+    }
+
+    inline const char* log_unpack(log_str s, const char* rec) {
+        return rec + s.offset;
+    }
+
+    template <class TUPLE>
+    constexpr size_t log_args_offset() {
+        return (sizeof(log_record) + alignof(TUPLE) - 1) &
+               ~(alignof(TUPLE) - 1);
+    }
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+
+    template <class TUPLE, size_t... I>
+    int log_format(char* buf, size_t size, const log_record* rec,
+                   std::index_sequence<I...>) {
+        const char* base = (const char*)rec;
+        const TUPLE& args = *(const TUPLE*)(base + log_args_offset<TUPLE>());
+        return snprintf(buf, size, rec->fmt,
+                        log_unpack(std::get<I>(args), base)...);
+    }
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+    template <class TUPLE>
+    int log_format_record(char* buf, size_t size, const void* rec) {
+        return log_format<TUPLE>(buf, size, (const log_record*)rec,
+            std::make_index_sequence<std::tuple_size<TUPLE>::value>());
+    }
+
+    template <class... ARGS>
+    void log_message(const char* file, int line, const char* fmt,
+                     ARGS... args) {
+        typedef std::tuple<decltype(log_pack(args, std::declval<char*>(),
+                                    std::declval<size_t&>()))...> TUPLE;
+        static_assert(log_args_offset<TUPLE>() + sizeof(TUPLE) <
+                      LOG_MAX_RECORD / 2, "too many log arguments");
+        static_assert(alignof(TUPLE) <= LOG_ALIGN, "log argument alignment");
+
+        alignas(LOG_ALIGN) char buf[LOG_MAX_RECORD];
+        size_t used = log_args_offset<TUPLE>() + sizeof(TUPLE);
+        new (buf + log_args_offset<TUPLE>()) TUPLE(
+            log_pack(args, buf, used)...);
+
+        log_record* rec = (log_record*)buf;
+        rec->size = (u32)((used + LOG_ALIGN - 1) & ~(LOG_ALIGN - 1));
+        rec->line = (u32)line;
+        rec->format = &log_format_record<TUPLE>;
+        rec->file = file;
+        rec->fmt = fmt;
+        log_submit(rec);
+    }
+
+}
+
+#endif
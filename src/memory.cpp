@@ -9,20 +9,70 @@
 #include "memory.h"
 
 #ifndef WIN32
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
+#include <errno.h>
+
 #include <inttypes.h>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 
 namespace ocx {
 
-    memory::memory(u64 size, u64 alignment) :
+    image::image(const char* path) :
+        m_size(0),
+        m_data(nullptr),
+        m_fd(-1),
+        m_copy() {
+#ifdef WIN32
+        std::ifstream file(path, std::ios::binary);
+        ERROR_ON(!file.good(), "unable to read %s", path);
+        m_copy.assign(std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>());
+        m_size = m_copy.size();
+        m_data = m_copy.data();
+#else
+        m_fd = open(path, O_RDONLY | O_CLOEXEC);
+        ERROR_ON(m_fd < 0, "unable to read %s: %s", path, strerror(errno));
+
+        struct stat st;
+        ERROR_ON(fstat(m_fd, &st) != 0, "unable to stat %s: %s", path,
+                 strerror(errno));
+        m_size = st.st_size;
+        if (m_size == 0)
+            return;
+
+        void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        ERROR_ON(data == MAP_FAILED, "unable to map %s: %s", path,
+                 strerror(errno));
+        m_data = (const u8*)data;
+#endif
+    }
+
+    image::~image() {
+#ifndef WIN32
+        if (m_data != nullptr)
+            (void)munmap((void*)m_data, m_size);
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    memory::memory(u64 size, u64 alignment, bool shareable) :
         m_size(size),
         m_memory(nullptr),
-        m_buffer(nullptr) {
+        m_buffer(nullptr),
+        m_reserved(size + alignment),
+        m_fd(-1),
+        m_regions() {
 #ifdef WIN32
+        ERROR_ON(shareable, "shareable memory not supported on Windows");
         m_buffer = _aligned_malloc(size, alignment);
         m_memory = (u8*)m_buffer;
         ERROR_ON(m_memory == nullptr,
@@ -30,13 +80,25 @@ namespace ocx {
 #else
         const int p_flags = PROT_READ|PROT_WRITE|PROT_EXEC;
         const int m_flags = MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE;
-        m_buffer = mmap(NULL, size + alignment, p_flags, m_flags, -1, 0);
+        m_buffer = mmap(NULL, m_reserved, p_flags, m_flags, -1, 0);
         ERROR_ON(m_buffer == MAP_FAILED,
                  "Unable to reserve %" PRIu64 " bytes of memory\n", size);
 
         uintptr_t aligned_start = ((uintptr_t)m_buffer + (alignment - 1))
                                   & ~(alignment - 1);
         m_memory = (u8*)aligned_start;
+
+        if (shareable) {
+            m_fd = memfd_create("ocx-memory", MFD_CLOEXEC);
+            ERROR_ON(m_fd < 0, "memfd_create failed: %s", strerror(errno));
+            ERROR_ON(ftruncate(m_fd, size) != 0, "Unable to reserve %" PRIu64
+                     " bytes of memory: %s\n", size, strerror(errno));
+
+            void* p = mmap(m_memory, size, p_flags, MAP_SHARED|MAP_FIXED,
+                           m_fd, 0);
+            ERROR_ON(p == MAP_FAILED, "Unable to map %" PRIu64 " bytes of "
+                     "memory: %s\n", size, strerror(errno));
+        }
 #endif
     }
 
@@ -44,11 +106,47 @@ namespace ocx {
 #ifdef WIN32
         _aligned_free(m_buffer);
 #else
-        (void)munmap(m_buffer, m_size);
+        for (auto& r : m_regions)
+            (void)munmap(r.map, r.map_size);
+        (void)munmap(m_buffer, m_reserved);
+        if (m_fd >= 0)
+            close(m_fd);
 #endif
     }
 
-    void memory::load(const char* path) {
+    u64 memory::get_limit() const {
+        u64 limit = m_size;
+        for (auto& r : m_regions)
+            limit = std::max(limit, r.base + r.size);
+        return limit;
+    }
+
+    void memory::add_region(const region& r) {
+        ERROR_ON(r.size == 0 || r.base + r.size < r.base,
+                 "invalid region at 0x%" PRIx64, r.base);
+        ERROR_ON(r.base < m_size, "region at 0x%" PRIx64 " overlaps RAM",
+                 r.base);
+        for (auto& other : m_regions) {
+            ERROR_ON(r.base < other.base + other.size &&
+                     other.base < r.base + r.size,
+                     "region at 0x%" PRIx64 " overlaps region at 0x%" PRIx64,
+                     r.base, other.base);
+        }
+
+        m_regions.push_back(r);
+    }
+
+    const memory::region* memory::find(u64 addr, u64 size) const {
+        for (auto& r : m_regions) {
+            if (addr >= r.base && addr - r.base < r.size &&
+                size <= r.size - (addr - r.base))
+                return &r;
+        }
+
+        return nullptr;
+    }
+
+    u64 memory::load(const char* path, u64 offset) {
 
         std::ifstream file(path, std::ios::binary);
         file.unsetf(std::ios::skipws);
@@ -60,15 +158,146 @@ namespace ocx {
         file_size = file.tellg();
         file.seekg(0, std::ios::beg);
 
-        ERROR_ON ((u64)file_size > m_size,
-                  "file %s larger than memory size %" PRIu64, path, m_size);
+        ERROR_ON (offset > m_size || (u64)file_size > m_size - offset,
+                  "file %s does not fit into memory of size %" PRIu64
+                  " at offset 0x%" PRIx64, path, m_size, offset);
 
-        file.read((char*)m_memory, file_size);
+        file.read((char*)m_memory + offset, file_size);
         ERROR_ON(!file.good(), "unable to read %s", path);
+        return (u64)file_size;
+    }
+
+    u64 memory::load(const image& img, u64 offset) {
+        u64 size = img.get_size();
+        ERROR_ON(offset > m_size || size > m_size - offset,
+                 "image of size %" PRIu64 " does not fit into memory of size "
+                 "%" PRIu64 " at offset 0x%" PRIx64, size, m_size, offset);
+        if (size == 0)
+            return 0;
+
+#ifndef WIN32
+        // map the file copy-on-write over guest memory, so that pages the
+        // guest does not write stay shared between all memories using img;
+        // shareable memory must keep its memfd pages, so it gets a copy
+        u64 page_size = sysconf(_SC_PAGESIZE);
+        u64 len = (size + page_size - 1) & ~(page_size - 1);
+        u8* addr = m_memory + offset;
+        if (img.get_fd() >= 0 && m_fd < 0 &&
+            ((uintptr_t)addr & (page_size - 1)) == 0 &&
+            len <= m_size - offset) {
+            const int p_flags = PROT_READ|PROT_WRITE|PROT_EXEC;
+            void* p = mmap(addr, len, p_flags, MAP_PRIVATE|MAP_FIXED,
+                           img.get_fd(), 0);
+            ERROR_ON(p == MAP_FAILED, "unable to map image: %s",
+                     strerror(errno));
+            return size;
+        }
+#endif
+
+        memcpy(m_memory + offset, img.get_ptr(), size);
+        return size;
+    }
+
+    void memory::alias(u64 addr, u64 target, u64 size) {
+#ifdef WIN32
+        (void)addr;
+        (void)target;
+        (void)size;
+        ERROR("memory aliases not supported on Windows");
+#else
+        ERROR_ON(m_fd < 0, "memory aliases require shareable memory");
+
+        u64 page_size = sysconf(_SC_PAGESIZE);
+        ERROR_ON((addr | target | size) & (page_size - 1),
+                 "alias at 0x%" PRIx64 " is not page aligned", addr);
+        ERROR_ON(target > m_size || size > m_size - target,
+                 "alias at 0x%" PRIx64 " exceeds memory", addr);
+
+        const int p_flags = PROT_READ|PROT_WRITE|PROT_EXEC;
+        void* p = mmap(NULL, size, p_flags, MAP_SHARED, m_fd, target);
+        ERROR_ON(p == MAP_FAILED, "unable to map alias at 0x%" PRIx64 ": %s",
+                 addr, strerror(errno));
+
+        add_region(region{ addr, size, (u8*)p, false, target, p, size });
+#endif
+    }
+
+    u64 memory::map_rom(u64 addr, const image& img) {
+#ifdef WIN32
+        (void)addr;
+        (void)img;
+        ERROR("ROM regions not supported on Windows");
+#else
+        u64 page_size = sysconf(_SC_PAGESIZE);
+        ERROR_ON(addr & (page_size - 1), "ROM at 0x%" PRIx64 " is not page "
+                 "aligned", addr);
+        ERROR_ON(img.get_fd() < 0 || img.get_size() == 0,
+                 "ROM at 0x%" PRIx64 " has no image", addr);
+
+        u64 size = (img.get_size() + page_size - 1) & ~(page_size - 1);
+        void* p = mmap(NULL, size, PROT_READ|PROT_EXEC, MAP_SHARED,
+                       img.get_fd(), 0);
+        ERROR_ON(p == MAP_FAILED, "unable to map ROM at 0x%" PRIx64 ": %s",
+                 addr, strerror(errno));
+
+        add_region(region{ addr, size, (u8*)p, true, ~0ull, p, size });
+        return size;
+#endif
+    }
+
+    u8* memory::get_page_ptr(u64 addr, bool write) const {
+        if (addr < m_size)
+            return m_memory + addr;
+
+        const region* r = find(addr, 1);
+        if (r == nullptr || (write && r->readonly))
+            return nullptr;
+        return r->host + (addr - r->base);
+    }
+
+    void memory::aliases(u64 start, u64 end,
+                         std::vector<std::pair<u64, u64>>& ranges) const {
+        ranges.push_back(std::make_pair(start, end));
+
+        // translate the part of an alias back to RAM first
+        const region* r = find(start, 1);
+        if (r != nullptr && !r->readonly) {
+            end = std::min(end, r->base + r->size - 1);
+            start = start - r->base + r->target;
+            end = end - r->base + r->target;
+            ranges.push_back(std::make_pair(start, end));
+        }
+
+        if (start >= m_size)
+            return;
+
+        for (auto& a : m_regions) {
+            if (a.readonly || a.target > end || start >= a.target + a.size)
+                continue;
+
+            u64 lo = std::max(start, a.target);
+            u64 hi = std::min(end, a.target + a.size - 1);
+            u64 addr = lo - a.target + a.base;
+            if (r != &a)
+                ranges.push_back(std::make_pair(addr, addr + hi - lo));
+        }
     }
 
     ocx::response memory::transact(const ocx::transaction& tx) {
-        (void)tx;
-        return RESP_FAILED;
+        u8* host = nullptr;
+        if (tx.addr < m_size && tx.size <= m_size - tx.addr) {
+            host = m_memory + tx.addr;
+        } else {
+            const region* r = find(tx.addr, tx.size);
+            if (r == nullptr || (!tx.is_read && r->readonly))
+                return RESP_FAILED;
+            host = r->host + (tx.addr - r->base);
+        }
+
+        if (tx.is_read)
+            memcpy(tx.data, host, tx.size);
+        else
+            memcpy(host, tx.data, tx.size);
+        return RESP_OK;
     }
 }
@@ -10,29 +10,99 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <utility>
+#include <vector>
 
 #include "ocx/ocx.h"
 
 namespace ocx {
 
+    // read-only view of an image file that can be loaded into any number of
+    // memories; where possible, the file is mapped so that all private
+    // memories it is loaded into share its unmodified pages with the page
+    // cache, and ROMs mapped from it are always shared that way
+    class image
+    {
+    private:
+        u64 m_size;
+        const u8* m_data;
+        int m_fd;
+        std::vector<u8> m_copy;
+
+        image() = delete;
+        image(const image&) = delete;
+
+    public:
+        image(const char* path);
+        virtual ~image();
+
+        inline const u8* get_ptr()  const { return m_data; }
+        inline u64       get_size() const { return m_size; }
+        inline int       get_fd()   const { return m_fd; }
+    };
+
+    // Guest RAM at address 0, plus further regions above it: aliases that
+    // map part of the RAM a second time and read-only ROMs mapped from
+    // image files. Neither kind copies any data.
     class memory
     {
     private:
+        struct region {
+            u64   base;
+            u64   size;
+            u8*   host;
+            bool  readonly;
+            u64   target;   // RAM offset of aliases
+            void* map;      // host mapping owned by the region
+            u64   map_size;
+        };
+
         u64 m_size;
         u8* m_memory;
         void* m_buffer;
+        u64 m_reserved;
+        int m_fd;
+        std::vector<region> m_regions;
 
         memory() = delete;
         memory(const memory&) = delete;
 
+        void add_region(const region& r);
+        const region* find(u64 addr, u64 size) const;
+
     public:
-        memory(u64 size, u64 alignment);
+        // shareable memory is backed by a memfd instead of private anonymous
+        // memory, which aliases require; it cannot be used in forked
+        // children that expect copy-on-write guest memory
+        memory(u64 size, u64 alignment, bool shareable = false);
         virtual ~memory();
 
         inline u8* get_ptr()  const { return m_memory; }
         inline u64 get_size() const { return m_size; }
 
-        void load(const char*);
+        // end of the highest mapped guest address
+        u64 get_limit() const;
+
+        u64 load(const char* path, u64 offset = 0);
+        u64 load(const image& img, u64 offset = 0);
+
+        // maps RAM [target, target + size) at guest address addr as well;
+        // all addresses must be page aligned
+        void alias(u64 addr, u64 target, u64 size);
+
+        // maps img read-only at the page aligned guest address addr; the
+        // pages are shared with every process that maps the same file and
+        // the region size is rounded up to full pages
+        u64 map_rom(u64 addr, const image& img);
+
+        // host pointer of the page at addr or nullptr if it is not mapped,
+        // or if write is set and the page is read-only
+        u8* get_page_ptr(u64 addr, bool write) const;
+
+        // appends all guest ranges that refer to the same bytes as the
+        // guest range [start, end], including the range itself
+        void aliases(u64 start, u64 end,
+                     std::vector<std::pair<u64, u64>>& ranges) const;
 
         ocx::response transact(const ocx::transaction& tx);
     };
@@ -9,6 +9,13 @@
 
 #include "corelib.h"
 #include "memory.h"
+#include "platform.h"
+#include "forkserver.h"
+#include "blockdev.h"
+#include "topology.h"
+#include "recorder.h"
+#include "bbv.h"
+#include "batch.h"
 #include "getopt.h"
 
 #ifdef ERROR
@@ -17,132 +24,194 @@
 
 #include "common.h"
 
+#include <errno.h>
 #include <inttypes.h>
-#include <vector>
+#include <chrono>
+#include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 using namespace std;
 
-namespace ocx {
-    class runenv : public env {
-    public:
-        runenv(memory &mem) :
-            m_mem(mem)
-        {}
-
-        ~runenv() {}
-
-        u8* get_page_ptr_r(u64 page_paddr) override {
-            if (page_paddr >= m_mem.get_size())
-                return nullptr;
-            return m_mem.get_ptr() + page_paddr;
-        }
-
-        u8* get_page_ptr_w(u64 page_paddr) override {
-            if (page_paddr >= m_mem.get_size())
-                return nullptr;
-            return m_mem.get_ptr() + page_paddr;
-        }
-
-        void protect_page(u8* page_ptr, u64 page_addr) override {
-            (void)page_ptr;
-            (void)page_addr;
-            abort();
-        }
-
-        response transport(const transaction& tx) override {
-            if (tx.addr == 0x40000000) {
-                if (tx.is_read || tx.size != 4)
-                    return RESP_FAILED;
-                putchar(*(u32*)tx.data);
-                return RESP_OK;
-            }
-            return m_mem.transact(tx);
-        };
-
-        void signal(u64 sigid, bool set) override {
-            (void)sigid;
-            (void)set;
-            abort();
-        }
-
-        void broadcast_syscall(int callno, shared_ptr<void> arg,
-                               bool async) override {
-            (void)callno;
-            (void)arg;
-            (void)async;
-            abort();
-        }
-
-        u64 get_time_ps() override {
-            abort();
-        }
-
-        const char* get_param(const char* name) override {
-            (void)name;
-            return nullptr;
-        }
-
-        void notify(u64 eventid, u64 time_ps) override {
-            (void)eventid;
-            (void)time_ps;
-            abort();
-        };
-
-        void cancel(u64 eventid) override {
-            (void)eventid;
-            abort();
-        }
-
-        void hint(hint_kind kind) override {
-            (void)kind;
-        }
-
-        void handle_begin_basic_block(u64 vaddr) override {
-            (void)vaddr;
-        }
-
-        bool handle_breakpoint(u64 vaddr) override {
-            (void)vaddr;
-            abort();
-        }
-
-        bool handle_watchpoint(u64 vaddr, u64 size, u64 data,
-                               bool iswr) override {
-            (void)vaddr;
-            (void)size;
-            (void)data;
-            (void)iswr;
-            abort();
-        }
-
-    private:
-        memory &m_mem;
-    };
-}
-
 static void usage(const char* name) {
     fprintf(stderr, "Usage: %s -b file [-m size] ", name);
-    fprintf(stderr, "[-n num] [-q num] <ocx-lib> <variant>\n");
+    fprintf(stderr, "[-n num] [-q num] [-t ps] [-l num] ");
+    fprintf(stderr, "[-a|-s|-p [-y sync] [-k num]] [-d file [-o]] ");
+    fprintf(stderr, "[-f [-B num] [-i addr]] [-P pin] [-N numa] [-R file] ");
+    fprintf(stderr, "[-V file [-I num] [-K num]] [-A alias] [-r rom] ");
+    fprintf(stderr, "<ocx-lib> <variant>\n");
+    fprintf(stderr, "       %s -J file [-j num] [-S file] [-m size] ", name);
+    fprintf(stderr, "[-n num] [-q num] [-t ps] [-l num] [-A alias] ");
+    fprintf(stderr, "[-r rom] <ocx-lib> <variant>\n");
     fprintf(stderr, "Arguments:\n");
     fprintf(stderr, "  -b <file>   raw binary image to load into memory\n");
     fprintf(stderr, "  -m <size>   simulated memory size (in bytes)\n");
     fprintf(stderr, "  -n <cores>  number of core instances\n");
     fprintf(stderr, "  -q <n>      number of instructions per quantum\n");
+    fprintf(stderr, "  -t <ps>     simulated time per quantum for cores that "
+                    "can step by time\n");
+    fprintf(stderr, "  -l <n>      instruction limit per core and run\n");
+    fprintf(stderr, "  -a          drive all cores from one thread using "
+                    "asynchronous steps\n");
+    fprintf(stderr, "  -s          deterministic mode, round-robin quanta on "
+                    "one thread\n");
+    fprintf(stderr, "  -p          parallel mode, synchronize all cores after "
+                    "each quantum\n");
+    fprintf(stderr, "  -y <sync>   barrier for -p: central (default) or "
+                    "dissemination\n");
+    fprintf(stderr, "  -k <n>      let cores run ahead by up to n quanta in "
+                    "-p mode\n");
+    fprintf(stderr, "  -d <file>   disk image for the block device\n");
+    fprintf(stderr, "  -o          keep disk image writes in a copy-on-write "
+                    "overlay\n");
+    fprintf(stderr, "  -f          fork server mode, reads input files from "
+                    "stdin\n");
+    fprintf(stderr, "  -B <n>      boot instructions before forking, 0 runs "
+                    "until the marker\n");
+    fprintf(stderr, "  -i <addr>   guest address to load fork server "
+                    "inputs to\n");
+    fprintf(stderr, "  -P <pin>    pin core threads to host cpus: compact or "
+                    "scatter\n");
+    fprintf(stderr, "  -N <numa>   guest memory placement: interleave, bind or "
+                    "firsttouch\n");
+    fprintf(stderr, "  -R <file>   record env calls of core n to <file>.n for "
+                    "the replay core\n");
+    fprintf(stderr, "  -V <file>   collect basic block vectors of core n in "
+                    "<file>.n.bb and pick\n"
+                    "              simulation points\n");
+    fprintf(stderr, "  -I <n>      instructions per basic block vector "
+                    "interval\n");
+    fprintf(stderr, "  -K <n>      maximum number of simulation points per "
+                    "core\n");
+    fprintf(stderr, "  -A <alias>  map memory a second time, given as "
+                    "<addr>,<size>,<target>\n");
+    fprintf(stderr, "  -r <rom>    map an image file read-only, given as "
+                    "<addr>,<file>\n");
+    fprintf(stderr, "  -J <file>   batch mode, run the jobs listed in file "
+                    "(<name> <image> [limit])\n");
+    fprintf(stderr, "  -j <n>      number of batch threads, defaults to the "
+                    "number of host cpus\n");
+    fprintf(stderr, "  -S <file>   write the batch summary to file instead "
+                    "of stdout\n");
     fprintf(stderr, "  <ocx-lib>   the OCX core library to load\n");
     fprintf(stderr, "  <variant>   the OCX core variant to instantiate\n");
 }
 
-static void run_core(ocx::core* c, ocx::u64 quantum, ocx::u64 reset_pc) {
+struct region_arg {
+    ocx::u64    addr;
+    ocx::u64    size;
+    ocx::u64    target;
+    const char* path;
+};
+
+// parses <addr>,<size>,<target> for aliases and <addr>,<file> for ROMs
+static bool parse_region(const char* arg, bool rom, region_arg& r) {
+    char* end = nullptr;
+    r.addr = strtoull(arg, &end, 0);
+    if (end == arg || *end != ',')
+        return false;
+
+    if (rom) {
+        r.size = 0;
+        r.target = 0;
+        r.path = end + 1;
+        return *r.path != '\0';
+    }
 
-    c->write_reg(c->pc_regid(), &reset_pc);
+    const char* next = end + 1;
+    r.size = strtoull(next, &end, 0);
+    if (end == next || *end != ',')
+        return false;
 
-    ocx::u64 overshoot = 0;
-    for (;;) {
-        overshoot = c->step(quantum - overshoot);
-        if (overshoot >= quantum)
-            overshoot -= quantum;
+    next = end + 1;
+    r.target = strtoull(next, &end, 0);
+    r.path = nullptr;
+    return end != next && *end == '\0';
+}
+
+// writes SimPoint compatible .simpoints and .weights files
+static bool write_simpoints(const ocx::bbv& b, unsigned int max_k,
+                            const char* prefix, size_t core) {
+    vector<ocx::bbv::simpoint> points = b.cluster(max_k);
+    printf("Core %zu: %zu intervals, %zu basic blocks, %zu simulation "
+           "points\n", core, b.intervals().size(), b.num_blocks(),
+           points.size());
+
+    string base = string(prefix) + "." + to_string(core);
+    FILE* sp = fopen((base + ".simpoints").c_str(), "w");
+    FILE* wt = fopen((base + ".weights").c_str(), "w");
+    if (sp == nullptr || wt == nullptr) {
+        fprintf(stderr, "unable to write simulation points to %s\n",
+                base.c_str());
+        if (sp != nullptr)
+            fclose(sp);
+        if (wt != nullptr)
+            fclose(wt);
+        return false;
+    }
+
+    for (auto& p : points) {
+        fprintf(sp, "%zu %zu\n", p.interval, p.cluster);
+        fprintf(wt, "%f %zu\n", p.weight, p.cluster);
+        printf("  point %zu: instructions %" PRIu64 " to %" PRIu64
+               ", weight %.3f\n", p.cluster, p.start, p.end, p.weight);
     }
+
+    fclose(sp);
+    fclose(wt);
+    return true;
+}
+
+static int run_batch(corelib& cl, const char* variant, const char* jobs,
+                     unsigned int nthreads, const char* summary,
+                     ocx::u64 memsize, unsigned int ncores,
+                     unsigned int quantum, ocx::u64 quantum_ps,
+                     ocx::u64 limit, const vector<region_arg>& regions) {
+    ocx::batch b([&](ocx::env& env) {
+                     return cl.create_core(env, variant, OCX_API_VERSION);
+                 },
+                 [&](ocx::core* c) { cl.delete_core(c); },
+                 memsize, ncores, quantum, limit);
+    b.set_time_quantum(quantum_ps);
+    for (auto& r : regions) {
+        if (r.path == nullptr)
+            b.add_alias(r.addr, r.target, r.size);
+        else if (!b.add_rom(r.addr, r.path))
+            return EXIT_FAILURE;
+    }
+
+    FILE* in = fopen(jobs, "r");
+    if (in == nullptr) {
+        fprintf(stderr, "unable to open %s: %s\n", jobs, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    bool ok = b.read_jobs(in);
+    fclose(in);
+    if (!ok)
+        return EXIT_FAILURE;
+
+    if (nthreads == 0)
+        nthreads = 1;
+
+    printf("Running %zu jobs on %u threads with quantum %u\n", b.num_jobs(),
+           nthreads, quantum);
+    fflush(stdout);
+    b.run(nthreads);
+
+    FILE* out = summary != nullptr ? fopen(summary, "w") : stdout;
+    if (out == nullptr) {
+        fprintf(stderr, "unable to open %s: %s\n", summary, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int failed = b.write_summary(out);
+    if (out != stdout)
+        fclose(out);
+
+    printf("%zu jobs completed, %d failed\n", b.num_jobs(), failed);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char** argv) {
@@ -151,21 +220,105 @@ int main(int argc, char** argv) {
     char* ocx_variant = NULL;
     unsigned int memsize = 0x08000000; // 128MB
     unsigned int quantum = 1000000;    // 1M instructions
+    ocx::u64 quantum_ps = 0;           // instruction quanta
     unsigned int ncores = 1;
+    ocx::u64 limit = 0;                // no limit
+    bool async = false;
+    bool serial = false;
+    bool parallel = false;
+    ocx::barrier_kind sync = ocx::BARRIER_CENTRAL;
+    ocx::u64 lag = 0;
+    char* disk = NULL;
+    bool overlay = false;
+    bool fork_server = false;
+    ocx::u64 boot_insns = 0;           // boot until marker
+    ocx::u64 input_addr = 0;
+    ocx::pin_policy pin = ocx::PIN_NONE;
+    ocx::numa_policy numa = ocx::NUMA_DEFAULT;
+    char* record = NULL;
+    char* bbv_path = NULL;
+    ocx::u64 interval = 10000000;      // 10M instructions
+    unsigned int max_k = 10;
+    char* jobs = NULL;
+    unsigned int nthreads = std::thread::hardware_concurrency();
+    char* summary = NULL;
+    vector<region_arg> regions;
+    bool shareable = false;
+    region_arg region;
 
     int c; // parse command line
-    while ((c = getopt(argc, argv, "b:m:n:q:h")) != -1) {
+    while ((c = getopt(argc, argv, "b:m:n:q:t:l:aspy:k:d:ofB:i:P:N:"
+                                   "R:V:I:K:J:j:S:A:r:h")) != -1) {
         switch(c) {
         case 'b': binary    = optarg; break;
         case 'm': memsize   = atoi(optarg); break;
         case 'q': quantum   = atoi(optarg); break;
+        case 't': quantum_ps = strtoull(optarg, NULL, 0); break;
         case 'n': ncores    = atoi(optarg); break;
+        case 'l': limit     = strtoull(optarg, NULL, 0); break;
+        case 'a': async       = true; break;
+        case 's': serial      = true; break;
+        case 'p': parallel    = true; break;
+        case 'k': lag         = strtoull(optarg, NULL, 0); break;
+        case 'y':
+            if (strcmp(optarg, "central") == 0) {
+                sync = ocx::BARRIER_CENTRAL;
+            } else if (strcmp(optarg, "dissemination") == 0) {
+                sync = ocx::BARRIER_DISSEMINATION;
+            } else {
+                fprintf(stderr, "unknown barrier %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'P':
+            if (strcmp(optarg, "compact") == 0) {
+                pin = ocx::PIN_COMPACT;
+            } else if (strcmp(optarg, "scatter") == 0) {
+                pin = ocx::PIN_SCATTER;
+            } else {
+                fprintf(stderr, "unknown pinning policy %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'N':
+            if (strcmp(optarg, "interleave") == 0) {
+                numa = ocx::NUMA_INTERLEAVE;
+            } else if (strcmp(optarg, "bind") == 0) {
+                numa = ocx::NUMA_BIND;
+            } else if (strcmp(optarg, "firsttouch") == 0) {
+                numa = ocx::NUMA_FIRST_TOUCH;
+            } else {
+                fprintf(stderr, "unknown NUMA policy %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'R': record      = optarg; break;
+        case 'V': bbv_path    = optarg; break;
+        case 'I': interval    = strtoull(optarg, NULL, 0); break;
+        case 'K': max_k       = atoi(optarg); break;
+        case 'J': jobs        = optarg; break;
+        case 'j': nthreads    = atoi(optarg); break;
+        case 'S': summary     = optarg; break;
+        case 'A':
+        case 'r':
+            if (!parse_region(optarg, c == 'r', region)) {
+                fprintf(stderr, "invalid region %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            regions.push_back(region);
+            shareable |= c == 'A';
+            break;
+        case 'd': disk        = optarg; break;
+        case 'o': overlay     = true; break;
+        case 'f': fork_server = true; break;
+        case 'B': boot_insns  = strtoull(optarg, NULL, 0); break;
+        case 'i': input_addr  = strtoull(optarg, NULL, 0); break;
         case 'h': usage(argv[0]); return EXIT_SUCCESS;
         default : usage(argv[0]); return EXIT_FAILURE;
         }
     }
 
-    if (binary == nullptr) {
+    if (binary == nullptr && jobs == nullptr) {
         fprintf(stderr, "binary file must be specified\n");
         usage(argv[0]);
         return EXIT_FAILURE;
@@ -177,22 +330,117 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    if (async + serial + parallel > 1) {
+        fprintf(stderr, "only one of -a, -s and -p can be specified\n");
+        return EXIT_FAILURE;
+    }
+
+    if (quantum_ps > 0 && (async || fork_server)) {
+        fprintf(stderr, "-t is not supported with -a and -f\n");
+        return EXIT_FAILURE;
+    }
+
+    if (pin == ocx::PIN_NONE &&
+        (numa == ocx::NUMA_BIND || numa == ocx::NUMA_FIRST_TOUCH)) {
+        fprintf(stderr, "-N bind and firsttouch require -P\n");
+        return EXIT_FAILURE;
+    }
+
+    if (fork_server && shareable) {
+        fprintf(stderr, "aliases not supported in fork server mode\n");
+        return EXIT_FAILURE;
+    }
+
+    if (fork_server && disk != nullptr) {
+        fprintf(stderr, "block device not supported in fork server mode\n");
+        return EXIT_FAILURE;
+    }
+
+    if (fork_server && (record != nullptr || bbv_path != nullptr)) {
+        fprintf(stderr, "recording not supported in fork server mode\n");
+        return EXIT_FAILURE;
+    }
+
+    if (bbv_path != nullptr && interval == 0) {
+        fprintf(stderr, "basic block vector interval must not be zero\n");
+        return EXIT_FAILURE;
+    }
+
+    if (jobs != nullptr && (binary != nullptr || fork_server || async ||
+                            parallel || disk != nullptr || record != nullptr ||
+                            bbv_path != nullptr || pin != ocx::PIN_NONE ||
+                            numa != ocx::NUMA_DEFAULT)) {
+        fprintf(stderr, "-J only supports -j, -S, -m, -n, -q, -t, -l, -A, "
+                "-r and -s\n");
+        return EXIT_FAILURE;
+    }
+
     ocx_lib_path = argv[optind];
     ocx_variant =  argv[optind + 1];
 
     corelib cl(ocx_lib_path);
-    ocx::memory mem(memsize, 0x1000);
+    if (jobs != nullptr) {
+        return run_batch(cl, ocx_variant, jobs, nthreads, summary, memsize,
+                         ncores, quantum, quantum_ps, limit, regions);
+    }
+    ocx::topology topo;
+    vector<int> cpus = topo.assign(pin, ncores);
+    ocx::topology::numastat numa_start = topo.read_numastat();
+
+    ocx::memory mem(memsize, 0x1000, shareable);
     printf("Allocated 0x%" PRIx64 " bytes at 0x%p\n",
            mem.get_size(), mem.get_ptr());
 
+    // placement must happen before the image is loaded, since loading
+    // faults in the pages it touches
+    topo.place(numa, mem, cpus);
+    if (!cpus.empty()) {
+        printf("Pinning %u cores to %zu cpus on %d NUMA nodes\n", ncores,
+               topo.num_cpus(), topo.num_nodes());
+    }
+
     mem.load(binary);
     printf("Loaded file %s into memory\n", binary);
 
-    ocx::runenv env(mem);
+    for (auto& r : regions) {
+        if (r.path == nullptr) {
+            mem.alias(r.addr, r.target, r.size);
+            printf("Mapped 0x%" PRIx64 " bytes of memory at 0x%" PRIx64
+                   " to 0x%" PRIx64 "\n", r.size, r.target, r.addr);
+        } else {
+            ocx::image img(r.path);
+            ocx::u64 size = mem.map_rom(r.addr, img);
+            printf("Mapped ROM %s with 0x%" PRIx64 " bytes at 0x%" PRIx64
+                   "\n", r.path, size, r.addr);
+        }
+    }
+
+    ocx::platform plat(mem);
+    plat.set_cpus(cpus);
+    plat.set_time_quantum(quantum_ps);
+
+    unique_ptr<ocx::blockdev> blk;
+    if (disk != nullptr) {
+        blk.reset(new ocx::blockdev(plat, ocx::PLATFORM_BLOCK,
+                                    ocx::PLATFORM_BLOCK_IRQ, disk, overlay));
+        plat.map_device(blk.get());
+        printf("Mapped disk image %s%s\n", disk,
+               overlay ? " with copy-on-write overlay" : "");
+    }
 
     vector<ocx::core*> cores;
+    vector<unique_ptr<ocx::recorder>> recorders;
+    vector<unique_ptr<ocx::bbv>> bbvs;
     for (unsigned int i = 0; i < ncores; ++i) {
-        ocx::core* c = cl.create_core(env, ocx_variant, OCX_API_VERSION);
+        ocx::runenv& env = plat.create_env();
+        ocx::env* core_env = &env;
+        if (record != nullptr) {
+            string path = string(record) + "." + to_string(i);
+            recorders.emplace_back(new ocx::recorder(env, path.c_str()));
+            core_env = recorders.back().get();
+        }
+
+        ocx::core* c = cl.create_core(*core_env, ocx_variant, OCX_API_VERSION);
         if (c == 0) {
             fprintf(stderr, "Failed to create OCX core variant %s\n",
                     ocx_variant);
@@ -200,20 +448,85 @@ int main(int argc, char** argv) {
         }
 
         printf("Created OCX core %s (%s)\n", c->arch(), c->provider());
+
+        ocx::u64 reset_pc = 0;
+        c->write_reg(c->pc_regid(), &reset_pc);
+
+        if (record != nullptr)
+            recorders.back()->set_core(c);
+
+        plat.add_core(env, c);
         cores.push_back(c);
+
+        if (bbv_path != nullptr) {
+            string path = string(bbv_path) + "." + to_string(i) + ".bb";
+            bbvs.emplace_back(new ocx::bbv(interval, path.c_str()));
+            env.set_bbv(bbvs.back().get());
+            if (!c->trace_basic_blocks(true)) {
+                fprintf(stderr, "core %u does not support basic block "
+                        "tracing\n", i);
+                return EXIT_FAILURE;
+            }
+        }
     }
 
-    printf("Starting simulation with quantum %u\n", quantum);
+    int result = EXIT_SUCCESS;
+    if (fork_server) {
+        ocx::forkserver server(plat, quantum, input_addr, limit);
+        printf("Booting fork server with quantum %u\n", quantum);
+        server.boot(boot_insns);
+        result = server.serve(stdin) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else {
+        printf("Starting simulation with quantum %u\n", quantum);
+
+        auto start = chrono::steady_clock::now();
+        ocx::u64 insns = plat.insn_count();
+        if (async)
+            plat.run_async(quantum, limit);
+        else if (serial)
+            plat.run_serial(quantum, limit);
+        else if (parallel && lag > 0)
+            plat.run_parallel(quantum, limit, ocx::BARRIER_RELAXED, lag);
+        else if (parallel)
+            plat.run_parallel(quantum, limit, sync);
+        else
+            plat.run(quantum, limit);
+        insns = plat.insn_count() - insns;
+        double secs = chrono::duration<double>(chrono::steady_clock::now() -
+                                               start).count();
+
+        plat.report();
+        printf("Simulated %" PRIu64 " instructions in %.3f s (%.2f MIPS)\n",
+               insns, secs, secs > 0.0 ? insns / secs / 1e6 : 0.0);
+        printf("Checksum 0x%016" PRIx64 "\n", plat.checksum());
+
+        // numastat counts page allocations, not accesses, so this is only
+        // a proxy for how many guest pages ended up on a remote node
+        ocx::topology::numastat numa_end = topo.read_numastat();
+        ocx::u64 local = numa_end.local - numa_start.local;
+        ocx::u64 other = numa_end.other - numa_start.other;
+        if (topo.num_nodes() > 1 && local + other > 0) {
+            printf("Remote page allocations %.2f%%\n",
+                   100.0 * other / (local + other));
+        }
 
-    vector<thread> threads;
-    for (auto c : cores)
-        threads.emplace_back(run_core, c, quantum, 0);
+        for (size_t i = 0; i < recorders.size(); ++i) {
+            printf("Recorded %" PRIu64 " env calls of core %zu\n",
+                   recorders[i]->num_events(), i);
+        }
 
-    for (auto& t : threads)
-        t.join();
+        for (size_t i = 0; i < bbvs.size(); ++i) {
+            bbvs[i]->finish(cores[i]->insn_count());
+            if (!write_simpoints(*bbvs[i], max_k, bbv_path, i))
+                result = EXIT_FAILURE;
+        }
+
+        if (plat.exited())
+            result = plat.exit_code();
+    }
 
     for (auto c : cores)
         cl.delete_core(c);
 
-    return EXIT_SUCCESS;
+    return result;
 }
@@ -0,0 +1,85 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "pagemap.h"
+
+#include <inttypes.h>
+#include <algorithm>
+
+namespace ocx {
+
+    pagemap::pagemap(u64 size, u64 page_size) :
+        m_size(size),
+        m_shift(0),
+        m_words(0),
+        m_bits() {
+        ERROR_ON(page_size == 0 || (page_size & (page_size - 1)),
+                 "page size %" PRIu64 " is not a power of 2", page_size);
+        while ((1ull << m_shift) < page_size)
+            m_shift++;
+
+        u64 pages = (size + page_size - 1) >> m_shift;
+        m_words = (pages + 63) / 64;
+        m_bits.reset(new std::atomic<u64>[m_words]);
+        for (u64 i = 0; i < m_words; ++i)
+            m_bits[i] = 0;
+    }
+
+    pagemap::~pagemap() {
+    }
+
+    u64 pagemap::clear(u64 start, u64 end,
+                       std::vector<std::pair<u64, u64>>& ranges) {
+        if (start >= m_size || start > end)
+            return 0;
+        if (end >= m_size)
+            end = m_size - 1;
+
+        u64 first = start >> m_shift;
+        u64 last = end >> m_shift;
+        u64 count = 0;
+        for (u64 page = first; page <= last;) {
+            // whole words are handled at once, so large clean ranges are
+            // skipped quickly
+            u64 lo = page % 64;
+            u64 hi = std::min<u64>(63, lo + (last - page));
+            u64 mask = (hi == 63 ? ~0ull : (1ull << (hi + 1)) - 1) &
+                       ~((1ull << lo) - 1);
+            u64 bits = m_bits[page / 64].fetch_and(~mask) & mask;
+
+            for (u64 bit = lo; bits != 0; ++bit) {
+                if (!(bits & (1ull << bit)))
+                    continue;
+
+                bits &= ~(1ull << bit);
+                u64 addr = (page - lo + bit) << m_shift;
+                if (!ranges.empty() && ranges.back().second + 1 == addr)
+                    ranges.back().second = addr + page_size() - 1;
+                else
+                    ranges.push_back(std::make_pair(addr,
+                                                    addr + page_size() - 1));
+                count++;
+            }
+
+            page += hi - lo + 1;
+        }
+
+        return count;
+    }
+
+    u64 pagemap::count() const {
+        u64 result = 0;
+        for (u64 i = 0; i < m_words; ++i) {
+            for (u64 bits = m_bits[i].load(); bits != 0; bits &= bits - 1)
+                result++;
+        }
+
+        return result;
+    }
+
+}
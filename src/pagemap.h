@@ -0,0 +1,74 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "ocx/ocx.h"
+
+namespace ocx {
+
+    // Thread safe bitmap with one bit per page of guest physical memory.
+    // Addresses beyond the end of memory are ignored.
+    class pagemap
+    {
+    private:
+        u64 m_size;
+        u64 m_shift;
+        u64 m_words;
+
+        std::unique_ptr<std::atomic<u64>[]> m_bits;
+
+        pagemap() = delete;
+        pagemap(const pagemap&) = delete;
+
+    public:
+        // page_size must be a power of two
+        pagemap(u64 size, u64 page_size);
+        virtual ~pagemap();
+
+        inline u64 page_size() const { return 1ull << m_shift; }
+
+        inline void set(u64 addr) {
+            if (addr >= m_size)
+                return;
+
+            // avoid dirtying the cache line if the bit is already set
+            u64 page = addr >> m_shift;
+            u64 mask = 1ull << (page % 64);
+            std::atomic<u64>& word = m_bits[page / 64];
+            if (!(word.load(std::memory_order_relaxed) & mask))
+                word.fetch_or(mask, std::memory_order_relaxed);
+        }
+
+        inline bool test(u64 addr) const {
+            if (addr >= m_size)
+                return false;
+
+            u64 page = addr >> m_shift;
+            return m_bits[page / 64].load(std::memory_order_relaxed) &
+                   (1ull << (page % 64));
+        }
+
+        // clears the bits of all pages overlapping [start, end] and appends
+        // the address ranges of the pages that were set, merging adjacent
+        // pages; returns the number of pages that were set
+        u64 clear(u64 start, u64 end,
+                  std::vector<std::pair<u64, u64>>& ranges);
+
+        // number of pages currently set
+        u64 count() const;
+    };
+
+}
+
+#endif
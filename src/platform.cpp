@@ -0,0 +1,425 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "platform.h"
+#include "async_step.h"
+#include "topology.h"
+
+#include <inttypes.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace ocx {
+
+    platform::platform(memory& mem) :
+        m_mem(mem),
+        m_envs(),
+        m_cores(),
+        m_devices(),
+        m_stop(false),
+        m_exited(false),
+        m_marker(false),
+        m_exit_code(0),
+        m_step_mtx(),
+        m_step_cv(),
+        m_step_events(0),
+        m_sync(),
+        m_cpus(),
+        m_uart(stdout),
+        m_code_writes(0),
+        m_code_flushes(0),
+        m_quantum_ps(0),
+        m_timed(),
+        m_local_ps() {
+    }
+
+    platform::~platform() {
+        for (auto env : m_envs)
+            delete env;
+    }
+
+    runenv& platform::create_env() {
+        u64 id = m_envs.size();
+        runenv* env = new env_callbacks_adapter<runenv>(*this, id);
+        m_envs.push_back(env);
+        return *env;
+    }
+
+    void platform::add_core(runenv& env, core* c) {
+        ERROR_ON(env.get_id() != m_cores.size(), "cores added out of order");
+        env.set_core(c);
+        m_cores.push_back(c);
+        m_timed.push_back(query_extension<core_step_time_extension>(*c));
+        m_local_ps.push_back(0);
+    }
+
+    void platform::map_device(device* dev) {
+        for (auto other : m_devices) {
+            ERROR_ON(dev->contains(other->get_base(), 1) ||
+                     other->contains(dev->get_base(), 1),
+                     "device at 0x%" PRIx64 " overlaps device at 0x%" PRIx64,
+                     dev->get_base(), other->get_base());
+        }
+
+        m_devices.push_back(dev);
+    }
+
+    response platform::transport(u64 coreid, const transaction& tx) {
+        for (auto dev : m_devices) {
+            if (dev->contains(tx.addr, tx.size))
+                return dev->transport(coreid, tx.addr - dev->get_base(), tx);
+        }
+
+        switch (tx.addr) {
+        case PLATFORM_UART:
+            if (tx.is_read || tx.size != 4)
+                return RESP_FAILED;
+            fputc(*(u32*)tx.data, m_uart);
+            return RESP_OK;
+
+        case PLATFORM_EXIT:
+            if (tx.is_read || tx.size != 4)
+                return RESP_FAILED;
+            m_exit_code = *(int*)tx.data;
+            m_exited = true;
+            stop();
+            return RESP_OK;
+
+        case PLATFORM_MARKER:
+            if (tx.is_read || tx.size != 4)
+                return RESP_FAILED;
+            m_marker = true;
+            stop();
+            return RESP_OK;
+
+        default: {
+            response resp = m_mem.transact(tx);
+            if (resp == RESP_OK && tx.is_debug && !tx.is_read && tx.size > 0)
+                flush_code(tx.addr, tx.addr + tx.size - 1);
+            return resp;
+        }
+        }
+    }
+
+    void platform::stop() {
+        m_stop = true;
+        for (auto c : m_cores)
+            c->stop();
+    }
+
+    void platform::raise_irq(u64 coreid, u64 irq, bool set) {
+        m_envs.at(coreid)->set_irq(irq, set);
+        m_cores.at(coreid)->stop();
+    }
+
+    void platform::flush_code(u64 start, u64 end) {
+        // cores may have fetched the written bytes through any alias
+        std::vector<std::pair<u64, u64>> ranges;
+        m_mem.aliases(start, end, ranges);
+
+        m_code_writes++;
+        for (size_t i = 0; i < m_cores.size(); ++i) {
+            bool flushed = false;
+            for (auto& range : ranges)
+                flushed |= m_envs[i]->flush_code(range.first, range.second);
+
+            if (flushed) {
+                m_cores[i]->stop();
+                m_code_flushes++;
+            }
+        }
+    }
+
+    void platform::report() {
+        for (auto dev : m_devices)
+            dev->report();
+
+        if (m_code_writes > 0) {
+            printf("Code coherence: %" PRIu64 " host writes, %" PRIu64
+                   " of %" PRIu64 " core flushes needed\n",
+                   m_code_writes.load(), m_code_flushes.load(),
+                   m_code_writes * m_cores.size());
+        }
+
+        for (size_t i = 0; i < m_cores.size(); ++i) {
+            if (m_quantum_ps > 0 && m_timed[i] != nullptr) {
+                printf("Core %zu: %.3f us simulated time\n", i,
+                       m_local_ps[i] / 1e6);
+            }
+        }
+
+        if (m_sync == nullptr)
+            return;
+
+        for (size_t i = 0; i < m_sync->get_count(); ++i) {
+            u64 rounds = m_sync->rounds(i);
+            double ms = m_sync->wait_ns(i) / 1e6;
+            printf("Core %zu: %.3f ms barrier wait in %" PRIu64 " quanta "
+                   "(%.0f ns/quantum)\n", i, ms, rounds,
+                   rounds ? m_sync->wait_ns(i) / (double)rounds : 0.0);
+        }
+    }
+
+    void platform::notify_step() {
+        std::lock_guard<std::mutex> lock(m_step_mtx);
+        m_step_events++;
+        m_step_cv.notify_one();
+    }
+
+    u64 platform::next_quantum(core* c, u64 quantum, u64 overshoot, u64 end) {
+        if (m_stop)
+            return 0;
+
+        u64 num = quantum - overshoot;
+        if (end) {
+            u64 count = c->insn_count();
+            if (count >= end)
+                return 0;
+            if (end - count < num)
+                num = end - count;
+        }
+
+        return num;
+    }
+
+    u64 platform::next_quantum(size_t id, u64 quantum, u64 overshoot,
+                               u64 end) {
+        // cores stepping by time only need the instruction limit
+        if (m_quantum_ps > 0 && m_timed[id] != nullptr)
+            return next_quantum(m_cores[id], ~0ull, 0, end);
+        return next_quantum(m_cores[id], quantum, overshoot, end);
+    }
+
+    void platform::step_core(size_t id, u64 num, u64 quantum,
+                             u64& overshoot) {
+        // the core reports the exact time it used, so there is no
+        // overshoot to carry into the next quantum
+        if (m_quantum_ps > 0 && m_timed[id] != nullptr) {
+            u64 used_ps = 0;
+            m_timed[id]->step_time(m_quantum_ps, num == ~0ull ? 0 : num,
+                                   used_ps);
+            m_local_ps[id] += used_ps;
+            overshoot = 0;
+            return;
+        }
+
+        overshoot = m_cores[id]->step(num);
+        if (overshoot >= quantum)
+            overshoot -= quantum;
+    }
+
+    void platform::pin(size_t id) const {
+        if (id >= m_cpus.size())
+            return;
+
+        if (!topology::pin_thread(m_cpus[id]))
+            INFO("failed to pin core %zu to cpu %d", id, m_cpus[id]);
+    }
+
+    void platform::set_cpus(const std::vector<int>& cpus) {
+        m_cpus = cpus;
+    }
+
+    void platform::set_time_quantum(u64 ps) {
+        m_quantum_ps = ps;
+    }
+
+    void platform::run_core(runenv* env, u64 quantum, u64 limit) {
+        size_t id = env->get_id();
+        pin(id);
+        core* c = env->get_core();
+        u64 end = limit ? c->insn_count() + limit : 0;
+        u64 overshoot = 0;
+        for (;;) {
+            u64 num = next_quantum(id, quantum, overshoot, end);
+            if (num == 0)
+                break;
+
+            env->update();
+            step_core(id, num, quantum, overshoot);
+        }
+    }
+
+    void platform::run(u64 quantum, u64 limit) {
+        m_stop = false;
+
+        std::vector<std::thread> threads;
+        for (auto env : m_envs) {
+            threads.emplace_back(&platform::run_core, this, env, quantum,
+                                 limit);
+        }
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    void platform::run_async(u64 quantum, u64 limit) {
+        m_stop = false;
+        pin(0);
+
+        size_t n = m_cores.size();
+        std::vector<std::unique_ptr<async_step>> steps(n);
+        std::vector<core_async_step_extension*> exts(n);
+        std::vector<u64> ends(n);
+        std::vector<u64> overshoots(n);
+
+        size_t running = 0;
+        for (size_t i = 0; i < n; ++i) {
+            core* c = m_cores[i];
+            exts[i] = query_extension<core_async_step_extension>(*c);
+            ends[i] = limit ? c->insn_count() + limit : 0;
+            overshoots[i] = 0;
+
+            u64 num = next_quantum(c, quantum, 0, ends[i]);
+            if (num > 0) {
+                m_envs[i]->update();
+                steps[i].reset(new async_step(*m_envs[i], exts[i], num));
+                running++;
+            }
+        }
+
+        while (running > 0) {
+            u64 events;
+            {
+                std::lock_guard<std::mutex> lock(m_step_mtx);
+                events = m_step_events;
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                if (!steps[i] || !steps[i]->poll())
+                    continue;
+
+                overshoots[i] = steps[i]->result();
+                if (overshoots[i] >= quantum)
+                    overshoots[i] -= quantum;
+                steps[i].reset();
+
+                core* c = m_cores[i];
+                u64 num = next_quantum(c, quantum, overshoots[i], ends[i]);
+                if (num > 0) {
+                    m_envs[i]->update();
+                    steps[i].reset(new async_step(*m_envs[i], exts[i], num));
+                } else {
+                    running--;
+                }
+            }
+
+            // wait for the next completion, but wake up regularly so that
+            // host side work does not starve if a core is slow
+            std::unique_lock<std::mutex> lock(m_step_mtx);
+            m_step_cv.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+                return m_step_events != events;
+            });
+        }
+    }
+
+    void platform::run_serial(u64 quantum, u64 limit) {
+        m_stop = false;
+        pin(0);
+
+        size_t n = m_cores.size();
+        std::vector<u64> ends(n);
+        std::vector<u64> overshoots(n);
+        std::vector<u64> nums(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            ends[i] = limit ? m_cores[i]->insn_count() + limit : 0;
+            overshoots[i] = 0;
+        }
+
+        for (;;) {
+            // like run_parallel, only start a round if all cores take part
+            bool done = false;
+            for (size_t i = 0; i < n; ++i) {
+                nums[i] = next_quantum(i, quantum, overshoots[i], ends[i]);
+                done |= nums[i] == 0;
+            }
+
+            if (done)
+                break;
+
+            for (size_t i = 0; i < n; ++i) {
+                m_envs[i]->update();
+                step_core(i, nums[i], quantum, overshoots[i]);
+            }
+        }
+    }
+
+    void platform::run_lockstep(runenv* env, barrier* sync, u64 quantum,
+                                u64 limit) {
+        size_t id = env->get_id();
+        pin(id);
+        core* c = env->get_core();
+        u64 end = limit ? c->insn_count() + limit : 0;
+        u64 overshoot = 0;
+        for (;;) {
+            u64 num = next_quantum(id, quantum, overshoot, end);
+            if (sync->wait(id, num == 0))
+                break;
+
+            env->update();
+            step_core(id, num, quantum, overshoot);
+        }
+    }
+
+    void platform::run_parallel(u64 quantum, u64 limit, barrier_kind kind,
+                                u64 lag) {
+        m_stop = false;
+        m_sync.reset(barrier::create(kind, m_cores.size(), lag));
+
+        std::vector<std::thread> threads;
+        for (auto env : m_envs) {
+            threads.emplace_back(&platform::run_lockstep, this, env,
+                                 m_sync.get(), quantum, limit);
+        }
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    u64 platform::insn_count() const {
+        u64 count = 0;
+        for (auto c : m_cores)
+            count += c->insn_count();
+        return count;
+    }
+
+    static u64 hash_bytes(u64 hash, const u8* data, size_t size) {
+        const u64 prime = 0x100000001b3ull;
+
+        size_t i = 0;
+        for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+            u64 word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * prime;
+        }
+
+        for (; i < size; ++i)
+            hash = (hash ^ data[i]) * prime;
+
+        return hash;
+    }
+
+    u64 platform::checksum() const {
+        u64 hash = hash_bytes(0xcbf29ce484222325ull, m_mem.get_ptr(),
+                              m_mem.get_size());
+
+        std::vector<u8> buf;
+        for (auto c : m_cores) {
+            for (u64 reg = 0; reg < c->num_regs(); ++reg) {
+                buf.assign(c->reg_size(reg), 0);
+                if (c->read_reg(reg, buf.data()))
+                    hash = hash_bytes(hash, buf.data(), buf.size());
+            }
+        }
+
+        return hash;
+    }
+
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <atomic>
+#include <cstdio>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ocx/ocx.h"
+#include "memory.h"
+#include "runenv.h"
+#include "device.h"
+#include "barrier.h"
+
+namespace ocx {
+
+    // memory mapped control registers of the runner platform
+    enum : u64 {
+        PLATFORM_UART   = 0x40000000, // write: print character
+        PLATFORM_EXIT   = 0x40000004, // write: stop simulation with exit code
+        PLATFORM_MARKER = 0x40000008, // write: signal end of boot phase
+        PLATFORM_BLOCK  = 0x40001000, // block device registers
+    };
+
+    enum : u64 {
+        PLATFORM_BLOCK_IRQ = 1,
+    };
+
+    class platform
+    {
+    private:
+        memory& m_mem;
+
+        std::vector<runenv*> m_envs;
+        std::vector<core*>   m_cores;
+        std::vector<device*> m_devices;
+
+        std::atomic<bool> m_stop;
+        std::atomic<bool> m_exited;
+        std::atomic<bool> m_marker;
+        std::atomic<int>  m_exit_code;
+
+        std::mutex              m_step_mtx;
+        std::condition_variable m_step_cv;
+        u64                     m_step_events;
+
+        std::unique_ptr<barrier> m_sync;
+
+        std::vector<int> m_cpus;
+
+        FILE* m_uart;
+
+        std::atomic<u64> m_code_writes;
+        std::atomic<u64> m_code_flushes;
+
+        u64 m_quantum_ps;
+        std::vector<core_step_time_extension*> m_timed;
+        std::vector<u64> m_local_ps;
+
+        platform() = delete;
+        platform(const platform&) = delete;
+
+        u64 next_quantum(core* c, u64 quantum, u64 overshoot, u64 end);
+        u64 next_quantum(size_t id, u64 quantum, u64 overshoot, u64 end);
+        void step_core(size_t id, u64 num, u64 quantum, u64& overshoot);
+        void pin(size_t id) const;
+        void run_core(runenv* env, u64 quantum, u64 limit);
+        void run_lockstep(runenv* env, barrier* sync, u64 quantum, u64 limit);
+
+    public:
+        platform(memory& mem);
+        virtual ~platform();
+
+        inline memory& get_memory() const { return m_mem; }
+
+        inline size_t num_cores() const { return m_cores.size(); }
+        inline core*  get_core(size_t i) const { return m_cores.at(i); }
+
+        inline bool exited()       const { return m_exited; }
+        inline bool marker_seen()  const { return m_marker; }
+        inline int  exit_code()    const { return m_exit_code; }
+
+        runenv& create_env();
+        void add_core(runenv& env, core* c);
+
+        // devices are not owned by the platform and must outlive it
+        void map_device(device* dev);
+
+        response transport(u64 coreid, const transaction& tx);
+
+        // thread safe, take effect before the affected cores' next quantum;
+        // flush_code must be called after the host wrote guest memory and
+        // only stops cores that fetched code from the written pages
+        void raise_irq(u64 coreid, u64 irq, bool set);
+        void flush_code(u64 start, u64 end);
+
+        // host cpus to pin the thread of each core to, empty for no pinning;
+        // modes that run all cores on one thread use the cpu of core 0
+        void set_cpus(const std::vector<int>& cpus);
+
+        // stream that receives the characters written to PLATFORM_UART,
+        // stdout by default
+        inline void set_uart(FILE* uart) { m_uart = uart; }
+
+        // length of a quantum in simulated time, 0 to use instruction
+        // quanta only; cores with core_step_time_extension then step by
+        // time, the others still by instructions. Not used by run_async.
+        void set_time_quantum(u64 ps);
+
+        void report();
+
+        // total number of instructions executed by all cores
+        u64 insn_count() const;
+
+        // hash over guest memory and the registers of all cores, used to
+        // compare the results of different execution modes
+        u64 checksum() const;
+
+        // requests all cores to return from step as soon as possible
+        void stop();
+
+        // wakes up run_async after a core has completed its quantum
+        void notify_step();
+
+        // runs all cores on their own thread until the platform is stopped
+        // or each core has executed another limit instructions (0 = forever)
+        void run(u64 quantum, u64 limit = 0);
+
+        // same as run, but drives all cores from the calling thread using
+        // asynchronous steps
+        void run_async(u64 quantum, u64 limit = 0);
+
+        // deterministic mode, steps all cores round-robin on the calling
+        // thread with a fixed interleaving
+        void run_serial(u64 quantum, u64 limit = 0);
+
+        // runs every core on its own thread, but synchronizes all cores at
+        // each quantum boundary; data race free guests produce the same
+        // results as in run_serial, except with BARRIER_RELAXED, which lets
+        // cores run ahead of the slowest core by up to lag quanta
+        void run_parallel(u64 quantum, u64 limit = 0,
+                          barrier_kind kind = BARRIER_CENTRAL, u64 lag = 0);
+    };
+
+}
+
+#endif
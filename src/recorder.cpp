@@ -0,0 +1,153 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "recorder.h"
+
+#include <errno.h>
+
+namespace ocx {
+
+    recorder::recorder(env& e, const char* path) :
+        m_env(e),
+        m_core(nullptr),
+        m_file(nullptr),
+        m_events(0) {
+        m_file = fopen(path, "wb");
+        ERROR_ON(m_file == nullptr, "unable to open %s: %s", path,
+                 strerror(errno));
+        setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+
+        trace_header hdr;
+        memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = TRACE_VERSION;
+        hdr.reserved = 0;
+        ERROR_ON(fwrite(&hdr, sizeof(hdr), 1, m_file) != 1,
+                 "unable to write %s", path);
+    }
+
+    recorder::~recorder() {
+        if (fclose(m_file) != 0)
+            INFO("error writing trace: %s", strerror(errno));
+    }
+
+    void recorder::record(trace_kind kind, u16 flags, u64 addr, u64 size,
+                          u64 arg, const void* data, u32 len) {
+        trace_event ev;
+        ev.kind = kind;
+        ev.flags = flags;
+        ev.len = len;
+        ev.insns = m_core != nullptr ? m_core->insn_count() : 0;
+        ev.addr = addr;
+        ev.size = size;
+        ev.arg = arg;
+
+        static const u8 zeros[8] = {};
+        bool ok = fwrite(&ev, sizeof(ev), 1, m_file) == 1;
+        if (len > 0) {
+            ok &= fwrite(data, len, 1, m_file) == 1;
+            ok &= fwrite(zeros, trace_padded(len) - len, 1, m_file) <= 1;
+        }
+
+        ERROR_ON(!ok, "error writing trace: %s", strerror(errno));
+        m_events++;
+    }
+
+    u8* recorder::get_page_ptr_r(u64 page_paddr) {
+        record(TRACE_PAGE_PTR_R, 0, page_paddr, 0, 0);
+        return m_env.get_page_ptr_r(page_paddr);
+    }
+
+    u8* recorder::get_page_ptr_w(u64 page_paddr) {
+        record(TRACE_PAGE_PTR_W, 0, page_paddr, 0, 0);
+        return m_env.get_page_ptr_w(page_paddr);
+    }
+
+    void recorder::protect_page(u8* page_ptr, u64 page_addr) {
+        record(TRACE_PROTECT_PAGE, 0, page_addr, 0, 0);
+        m_env.protect_page(page_ptr, page_addr);
+    }
+
+    response recorder::transport(const transaction& tx) {
+        // record after the call, so that reads capture the returned data
+        response resp = m_env.transport(tx);
+
+        u16 flags = (tx.is_read   ? TRACE_FLAG_READ   : 0) |
+                    (tx.is_user   ? TRACE_FLAG_USER   : 0) |
+                    (tx.is_secure ? TRACE_FLAG_SECURE : 0) |
+                    (tx.is_insn   ? TRACE_FLAG_INSN   : 0) |
+                    (tx.is_excl   ? TRACE_FLAG_EXCL   : 0) |
+                    (tx.is_lock   ? TRACE_FLAG_LOCK   : 0) |
+                    (tx.is_port   ? TRACE_FLAG_PORT   : 0) |
+                    (tx.is_debug  ? TRACE_FLAG_DEBUG  : 0);
+        record(TRACE_TRANSPORT, flags, tx.addr, tx.size, resp, tx.data,
+               (u32)tx.size);
+        return resp;
+    }
+
+    void recorder::signal(u64 sigid, bool set) {
+        record(TRACE_SIGNAL, set ? TRACE_FLAG_SET : 0, sigid, 0, 0);
+        m_env.signal(sigid, set);
+    }
+
+    void recorder::broadcast_syscall(int callno, std::shared_ptr<void> arg,
+                                     bool async) {
+        m_env.broadcast_syscall(callno, arg, async);
+    }
+
+    u64 recorder::get_time_ps() {
+        u64 time_ps = m_env.get_time_ps();
+        record(TRACE_GET_TIME, 0, 0, 0, time_ps);
+        return time_ps;
+    }
+
+    const char* recorder::get_param(const char* name) {
+        return m_env.get_param(name);
+    }
+
+    void recorder::notify(u64 eventid, u64 time_ps) {
+        record(TRACE_NOTIFY, 0, eventid, 0, time_ps);
+        m_env.notify(eventid, time_ps);
+    }
+
+    void recorder::cancel(u64 eventid) {
+        record(TRACE_CANCEL, 0, eventid, 0, 0);
+        m_env.cancel(eventid);
+    }
+
+    void recorder::hint(hint_kind kind) {
+        record(TRACE_HINT, 0, 0, 0, kind);
+        m_env.hint(kind);
+    }
+
+    void recorder::handle_begin_basic_block(u64 vaddr) {
+        record(TRACE_BASIC_BLOCK, 0, vaddr, 0, 0);
+        m_env.handle_begin_basic_block(vaddr);
+    }
+
+    bool recorder::handle_breakpoint(u64 vaddr) {
+        bool result = m_env.handle_breakpoint(vaddr);
+        record(TRACE_BREAKPOINT, result ? TRACE_FLAG_RESULT : 0, vaddr, 0, 0);
+        return result;
+    }
+
+    bool recorder::handle_watchpoint(u64 vaddr, u64 size, u64 data,
+                                     bool iswr) {
+        bool result = m_env.handle_watchpoint(vaddr, size, data, iswr);
+        u16 flags = (iswr ? TRACE_FLAG_SET : 0) |
+                    (result ? TRACE_FLAG_RESULT : 0);
+        record(TRACE_WATCHPOINT, flags, vaddr, size, data);
+        return result;
+    }
+
+    void* recorder::query_extension(u64 id) {
+        if (id == env_callbacks_extension::ID)
+            return nullptr;
+        return m_env.query_extension(id);
+    }
+
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdio>
+
+#include "ocx/ocx.h"
+#include "replay.h"
+
+namespace ocx {
+
+    // env wrapper that forwards all calls to another env and records them
+    // into a trace file for the replay core. Calls are stamped with the
+    // instruction count of the core set with set_core. Syscall broadcasts
+    // and parameter queries are forwarded, but not recorded.
+    class recorder : public env
+    {
+    private:
+        env&  m_env;
+        core* m_core;
+        FILE* m_file;
+        u64   m_events;
+
+        recorder() = delete;
+        recorder(const recorder&) = delete;
+
+        void record(trace_kind kind, u16 flags, u64 addr, u64 size, u64 arg,
+                    const void* data = nullptr, u32 len = 0);
+
+    public:
+        recorder(env& e, const char* path);
+        virtual ~recorder();
+
+        inline u64  num_events() const { return m_events; }
+        inline void set_core(core* c) { m_core = c; }
+
+        u8* get_page_ptr_r(u64 page_paddr) override;
+        u8* get_page_ptr_w(u64 page_paddr) override;
+
+        void protect_page(u8* page_ptr, u64 page_addr) override;
+
+        response transport(const transaction& tx) override;
+        void signal(u64 sigid, bool set) override;
+
+        void broadcast_syscall(int callno, std::shared_ptr<void> arg,
+                               bool async) override;
+
+        u64 get_time_ps() override;
+        const char* get_param(const char* name) override;
+
+        void notify(u64 eventid, u64 time_ps) override;
+        void cancel(u64 eventid) override;
+
+        void hint(hint_kind kind) override;
+
+        void handle_begin_basic_block(u64 vaddr) override;
+        bool handle_breakpoint(u64 vaddr) override;
+        bool handle_watchpoint(u64 vaddr, u64 size, u64 data,
+                               bool iswr) override;
+
+        // extensions of the wrapped env are passed through, except for the
+        // callback table, which would bypass the recorder
+        void* query_extension(u64 id) override;
+    };
+
+}
+
+#endif
@@ -0,0 +1,426 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define OCX_DLL_EXPORT
+
+#include "ocx/ocx.h"
+#include "replay.h"
+
+namespace ocx {
+
+    // Replays the env calls recorded by the runner's recorder at full
+    // speed, without executing any instructions. Each step issues the
+    // recorded calls stamped with an instruction count inside the step.
+    // Responses and read data are compared against the recording.
+    class replaycore: public core
+    {
+    public:
+        replaycore(env& e, std::vector<u8>&& trace, size_t max_len):
+            core(),
+            m_env(e),
+            m_trace(std::move(trace)),
+            m_pos(sizeof(trace_header)),
+            m_buf(max_len),
+            m_num_insn(0),
+            m_stop(false),
+            m_events(0),
+            m_mismatches(0) {
+        }
+
+        virtual ~replaycore() {
+            if (m_mismatches > 0) {
+                std::cerr << "replay: " << m_mismatches << " of "
+                          << m_events << " replayed calls differ from the "
+                          << "recording" << std::endl;
+            }
+        }
+
+        virtual const char* provider() override {
+            return "ocx::replaycore";
+        }
+
+        virtual const char* arch() override {
+            return "NONE";
+        }
+
+        virtual const char* arch_gdb() override {
+            return "NONE";
+        }
+
+        virtual const char* arch_family() override {
+            return "NONE";
+        }
+
+        virtual u64 page_size() override {
+            return 4096;
+        }
+
+        virtual void set_id(u64 procid, u64 coreid) override {
+            (void)procid;
+            (void)coreid;
+        }
+
+        virtual u64 step(u64 num_insn) override {
+            m_stop = false;
+
+            u64 start = m_num_insn;
+            u64 end = start + num_insn;
+            while (m_pos < m_trace.size()) {
+                const trace_event& ev = event();
+                if (ev.insns >= end)
+                    break;
+
+                m_pos += sizeof(trace_event) + trace_padded(ev.len);
+                replay(ev, (const u8*)(&ev + 1));
+
+                // the instruction that caused the call has completed
+                if (m_stop) {
+                    if (ev.insns >= m_num_insn)
+                        m_num_insn = ev.insns + 1;
+                    return m_num_insn - start;
+                }
+            }
+
+            m_num_insn = end;
+            return num_insn;
+        }
+
+        virtual void stop() override {
+            m_stop = true;
+        }
+
+        virtual u64 insn_count() override {
+            return m_num_insn;
+        }
+
+        virtual void reset() override {
+            m_pos = sizeof(trace_header);
+            m_num_insn = 0;
+        }
+
+        virtual void interrupt(u64 irq, bool set) override {
+            (void)irq;
+            (void)set;
+        }
+
+        virtual void notified(u64 eventid) override {
+            (void)eventid;
+        }
+
+        virtual u64 pc_regid() override {
+            return 0;
+        }
+
+        virtual u64 sp_regid() override {
+            return 1;
+        }
+
+        virtual u64 num_regs() override {
+            return 2;
+        }
+
+        virtual size_t reg_size(u64 regid) override {
+            (void)regid;
+            return 4;
+        }
+
+        virtual const char* reg_name(u64 regid) override {
+            switch (regid) {
+            case 0: return "REPLAY_PC";
+            case 1: return "REPLAY_SP";
+            default: return "NONE";
+            }
+        }
+
+        virtual bool read_reg(u64 regid, void* buf) override {
+            (void)regid;
+            (void)buf;
+            return false;
+        }
+
+        virtual bool write_reg(u64 regid, const void* buf) override {
+            (void)regid;
+            (void)buf;
+            return false;
+        }
+
+        virtual bool add_breakpoint(u64 vaddr) override {
+            (void)vaddr;
+            return false;
+        }
+
+        virtual bool remove_breakpoint(u64 vaddr) override {
+            (void)vaddr;
+            return false;
+        }
+
+        virtual bool add_watchpoint(u64 vaddr, u64 sz, bool iswr) override {
+            (void)vaddr;
+            (void)sz;
+            (void)iswr;
+            return false;
+        }
+
+        virtual bool remove_watchpoint(u64 vaddr, u64 sz, bool iswr) override {
+            (void)vaddr;
+            (void)sz;
+            (void)iswr;
+            return false;
+        }
+
+        virtual bool trace_basic_blocks(bool on) override {
+            (void)on;
+            return false;
+        }
+
+        virtual bool virt_to_phys(u64 vaddr, u64& paddr) override {
+            (void)vaddr;
+            (void)paddr;
+            return false;
+        }
+
+        virtual void handle_syscall(int callno,
+                                    std::shared_ptr<void> arg) override {
+            (void)callno;
+            (void)arg;
+        }
+
+        virtual u64 disassemble(u64 addr, char* buf, size_t sz) override {
+            (void)addr;
+            (void)buf;
+            (void)sz;
+            return 0;
+        }
+
+        virtual void invalidate_page_ptrs() override {
+            return;
+        }
+
+        virtual void invalidate_page_ptr(u64 page_paddr) override {
+            (void)page_paddr;
+        }
+
+        virtual void tb_flush() override {
+            return;
+        }
+
+        virtual void tb_flush_page(u64 start, u64 end) override {
+            (void)start;
+            (void)end;
+        }
+
+        // checks that trace holds a header and complete events only and
+        // returns the largest payload in max_len
+        static bool validate(const std::vector<u8>& trace, size_t& max_len) {
+            const trace_header* hdr = (const trace_header*)trace.data();
+            if (trace.size() < sizeof(*hdr) ||
+                memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) != 0 ||
+                hdr->version != TRACE_VERSION)
+                return false;
+
+            max_len = 0;
+            size_t pos = sizeof(*hdr);
+            while (pos < trace.size()) {
+                if (trace.size() - pos < sizeof(trace_event))
+                    return false;
+
+                const trace_event* ev = (const trace_event*)&trace[pos];
+                u64 len = trace_padded(ev->len);
+                pos += sizeof(trace_event);
+                if (trace.size() - pos < len)
+                    return false;
+                if (ev->kind > TRACE_WATCHPOINT)
+                    return false;
+                if (ev->kind == TRACE_TRANSPORT && ev->size != ev->len)
+                    return false;
+
+                max_len = std::max<size_t>(max_len, ev->len);
+                pos += len;
+            }
+
+            return true;
+        }
+
+    private:
+        env&                  m_env;
+        std::vector<u8>       m_trace;
+        size_t                m_pos;
+        std::vector<u8>       m_buf;
+        std::atomic<u64>      m_num_insn;
+        std::atomic<bool>     m_stop;
+        u64                   m_events;
+        u64                   m_mismatches;
+
+        inline const trace_event& event() const {
+            return *(const trace_event*)&m_trace[m_pos];
+        }
+
+        void check(bool ok) {
+            if (!ok)
+                m_mismatches++;
+        }
+
+        void replay(const trace_event& ev, const u8* data) {
+            m_events++;
+            switch (ev.kind) {
+            case TRACE_PAGE_PTR_R:
+                m_env.get_page_ptr_r(ev.addr);
+                break;
+
+            case TRACE_PAGE_PTR_W:
+                m_env.get_page_ptr_w(ev.addr);
+                break;
+
+            case TRACE_PROTECT_PAGE:
+                // host pointers are not recorded, so look up the page again
+                m_env.protect_page(m_env.get_page_ptr_w(ev.addr), ev.addr);
+                break;
+
+            case TRACE_TRANSPORT: {
+                transaction tx;
+                tx.addr = ev.addr;
+                tx.size = ev.size;
+                tx.data = m_buf.data();
+                tx.is_read   = ev.flags & TRACE_FLAG_READ;
+                tx.is_user   = ev.flags & TRACE_FLAG_USER;
+                tx.is_secure = ev.flags & TRACE_FLAG_SECURE;
+                tx.is_insn   = ev.flags & TRACE_FLAG_INSN;
+                tx.is_excl   = ev.flags & TRACE_FLAG_EXCL;
+                tx.is_lock   = ev.flags & TRACE_FLAG_LOCK;
+                tx.is_port   = ev.flags & TRACE_FLAG_PORT;
+                tx.is_debug  = ev.flags & TRACE_FLAG_DEBUG;
+
+                if (tx.is_read)
+                    memset(tx.data, 0, tx.size);
+                else
+                    memcpy(tx.data, data, tx.size);
+
+                response resp = m_env.transport(tx);
+                check(resp == (response)ev.arg);
+                if (tx.is_read && resp == RESP_OK)
+                    check(memcmp(tx.data, data, tx.size) == 0);
+                break;
+            }
+
+            case TRACE_SIGNAL:
+                m_env.signal(ev.addr, ev.flags & TRACE_FLAG_SET);
+                break;
+
+            case TRACE_GET_TIME:
+                m_env.get_time_ps();
+                break;
+
+            case TRACE_NOTIFY:
+                m_env.notify(ev.addr, ev.arg);
+                break;
+
+            case TRACE_CANCEL:
+                m_env.cancel(ev.addr);
+                break;
+
+            case TRACE_HINT:
+                m_env.hint((hint_kind)ev.arg);
+                break;
+
+            case TRACE_BASIC_BLOCK:
+                m_env.handle_begin_basic_block(ev.addr);
+                break;
+
+            case TRACE_BREAKPOINT: {
+                bool result = m_env.handle_breakpoint(ev.addr);
+                check(result == !!(ev.flags & TRACE_FLAG_RESULT));
+                break;
+            }
+
+            case TRACE_WATCHPOINT: {
+                bool iswr = ev.flags & TRACE_FLAG_SET;
+                bool result = m_env.handle_watchpoint(ev.addr, ev.size, ev.arg,
+                                                      iswr);
+                check(result == !!(ev.flags & TRACE_FLAG_RESULT));
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+    };
+
+    static bool load_trace(const std::string& path, std::vector<u8>& trace) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        trace.assign(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // the variant names the trace to replay; the n-th core created by the
+    // library replays <variant>.<n> if it exists and <variant> otherwise
+    core* create_instance(u64 api_version, env& e, const char* variant) {
+        static std::atomic<u64> instances(0);
+
+        if (api_version != OCX_API_VERSION)
+            return nullptr;
+
+        // an empty trace for the conformance tests
+        std::vector<u8> trace(sizeof(trace_header));
+        if (strcmp(variant, "test") == 0) {
+            trace_header* hdr = (trace_header*)trace.data();
+            memcpy(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic));
+            hdr->version = TRACE_VERSION;
+            hdr->reserved = 0;
+        } else {
+            // not std::to_string, its unique symbols prevent unloading
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), ".%llu",
+                     (unsigned long long)instances++);
+            std::string path = std::string(variant) + suffix;
+            if (!load_trace(path, trace) && !load_trace(variant, trace)) {
+                std::cerr << "replay: unable to open trace " << variant
+                          << std::endl;
+                return nullptr;
+            }
+        }
+
+        size_t max_len = 0;
+        if (!replaycore::validate(trace, max_len)) {
+            std::cerr << "replay: " << variant << " is not a valid trace"
+                      << std::endl;
+            return nullptr;
+        }
+
+        return new replaycore(e, std::move(trace), max_len);
+    }
+
+    void delete_instance(core* cpu) {
+        if (cpu == nullptr)
+            return;
+
+        replaycore* rcpu = dynamic_cast<replaycore*>(cpu);
+        if (rcpu == nullptr) {
+            std::cerr << "attempt to delete foreign core " << cpu->provider()
+                      << std::endl;
+            abort();
+        }
+
+        delete rcpu;
+    }
+
+}
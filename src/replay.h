@@ -0,0 +1,80 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "ocx/ocx.h"
+
+namespace ocx {
+
+    // File format shared by the recording env of the runner and the replay
+    // core library. A trace holds the env calls of one core, each stamped
+    // with the instruction count of the core at the time of the call. A
+    // trace starts with a trace_header followed by trace_events, each of
+    // which is followed by len bytes of payload padded to eight bytes.
+
+    enum : u32 {
+        TRACE_VERSION = 1,
+    };
+
+    enum trace_kind : u16 {
+        TRACE_PAGE_PTR_R = 0, // addr: page address
+        TRACE_PAGE_PTR_W,     // addr: page address
+        TRACE_PROTECT_PAGE,   // addr: page address
+        TRACE_TRANSPORT,      // addr, size, arg: response, payload: data
+        TRACE_SIGNAL,         // addr: signal id, flags: set
+        TRACE_GET_TIME,       // arg: time in ps
+        TRACE_NOTIFY,         // addr: event id, arg: time in ps
+        TRACE_CANCEL,         // addr: event id
+        TRACE_HINT,           // arg: hint kind
+        TRACE_BASIC_BLOCK,    // addr: virtual address
+        TRACE_BREAKPOINT,     // addr: virtual address, flags: result
+        TRACE_WATCHPOINT,     // addr, size, arg: data, flags: write, result
+    };
+
+    enum trace_flags : u16 {
+        TRACE_FLAG_READ   = 1 << 0, // transaction flags
+        TRACE_FLAG_USER   = 1 << 1,
+        TRACE_FLAG_SECURE = 1 << 2,
+        TRACE_FLAG_INSN   = 1 << 3,
+        TRACE_FLAG_EXCL   = 1 << 4,
+        TRACE_FLAG_LOCK   = 1 << 5,
+        TRACE_FLAG_PORT   = 1 << 6,
+        TRACE_FLAG_DEBUG  = 1 << 7,
+
+        TRACE_FLAG_SET    = 1 << 0, // signal set or watchpoint write
+        TRACE_FLAG_RESULT = 1 << 1, // breakpoint and watchpoint result
+    };
+
+    struct trace_header {
+        char magic[8];
+        u32  version;
+        u32  reserved;
+    };
+
+    struct trace_event {
+        u16 kind;
+        u16 flags;
+        u32 len;
+        u64 insns;
+        u64 addr;
+        u64 size;
+        u64 arg;
+    };
+
+    static const char TRACE_MAGIC[8] = {
+        'O', 'C', 'X', 'T', 'R', 'A', 'C', 'E'
+    };
+
+    inline u64 trace_padded(u64 len) {
+        return (len + 7) & ~7ull;
+    }
+
+}
+
+#endif
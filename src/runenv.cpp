@@ -0,0 +1,173 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "runenv.h"
+#include "platform.h"
+
+#include <inttypes.h>
+
+namespace ocx {
+
+    runenv::runenv(platform& p, u64 id) :
+        m_platform(p),
+        m_id(id),
+        m_core(nullptr),
+        m_bbv(nullptr),
+        m_pending(false),
+        m_irq_state(0),
+        m_irq_dirty(0),
+        m_flush_mtx(),
+        m_flushes(),
+        m_code() {
+    }
+
+    runenv::~runenv() {
+    }
+
+    void runenv::set_core(core* c) {
+        m_core = c;
+        m_code.reset(new pagemap(m_platform.get_memory().get_limit(),
+                                 c->page_size()));
+    }
+
+    void runenv::set_irq(u64 irq, bool set) {
+        ERROR_ON(irq >= 64, "irq %" PRIu64 " out of range", irq);
+        if (set)
+            m_irq_state |= 1ull << irq;
+        else
+            m_irq_state &= ~(1ull << irq);
+        m_irq_dirty |= 1ull << irq;
+        m_pending = true;
+    }
+
+    bool runenv::flush_code(u64 start, u64 end) {
+        // the pages are fetched again after the flush, which sets their bits
+        // before any new code from them executes
+        std::lock_guard<std::mutex> lock(m_flush_mtx);
+        if (m_code->clear(start, end, m_flushes) == 0)
+            return false;
+
+        m_pending = true;
+        return true;
+    }
+
+    void runenv::update() {
+        if (!m_pending.exchange(false))
+            return;
+
+        std::vector<std::pair<u64, u64>> flushes;
+        {
+            std::lock_guard<std::mutex> lock(m_flush_mtx);
+            flushes.swap(m_flushes);
+        }
+
+        u64 page_size = m_code->page_size();
+        for (auto& range : flushes) {
+            m_core->tb_flush_page(range.first, range.second);
+            for (u64 page = range.first; page < range.second;
+                 page += page_size)
+                m_core->invalidate_page_ptr(page);
+        }
+
+        u64 dirty = m_irq_dirty.exchange(0);
+        u64 state = m_irq_state;
+        for (u64 irq = 0; dirty != 0; ++irq, dirty >>= 1) {
+            if (dirty & 1)
+                m_core->interrupt(irq, (state >> irq) & 1);
+        }
+    }
+
+    u8* runenv::get_page_ptr_r(u64 page_paddr) {
+        u8* ptr = m_platform.get_memory().get_page_ptr(page_paddr, false);
+        if (ptr != nullptr)
+            m_code->set(page_paddr);
+        return ptr;
+    }
+
+    u8* runenv::get_page_ptr_w(u64 page_paddr) {
+        // null for ROMs, so that writes fall back to transport
+        return m_platform.get_memory().get_page_ptr(page_paddr, true);
+    }
+
+    void runenv::protect_page(u8* page_ptr, u64 page_addr) {
+        (void)page_ptr;
+        (void)page_addr;
+        abort();
+    }
+
+    response runenv::transport(const transaction& tx) {
+        if (tx.is_insn && tx.size > 0) {
+            m_code->set(tx.addr);
+            m_code->set(tx.addr + tx.size - 1);
+        }
+        return m_platform.transport(m_id, tx);
+    }
+
+    void runenv::signal(u64 sigid, bool set) {
+        (void)sigid;
+        (void)set;
+        abort();
+    }
+
+    void runenv::broadcast_syscall(int callno, std::shared_ptr<void> arg,
+                                   bool async) {
+        (void)callno;
+        (void)arg;
+        (void)async;
+        abort();
+    }
+
+    u64 runenv::get_time_ps() {
+        abort();
+    }
+
+    const char* runenv::get_param(const char* name) {
+        (void)name;
+        return nullptr;
+    }
+
+    void runenv::notify(u64 eventid, u64 time_ps) {
+        (void)eventid;
+        (void)time_ps;
+        abort();
+    }
+
+    void runenv::cancel(u64 eventid) {
+        (void)eventid;
+        abort();
+    }
+
+    void runenv::hint(hint_kind kind) {
+        (void)kind;
+    }
+
+    void runenv::handle_begin_basic_block(u64 vaddr) {
+        if (m_bbv != nullptr)
+            m_bbv->begin_block(vaddr, m_core->insn_count());
+    }
+
+    bool runenv::handle_breakpoint(u64 vaddr) {
+        (void)vaddr;
+        abort();
+    }
+
+    bool runenv::handle_watchpoint(u64 vaddr, u64 size, u64 data,
+                                   bool iswr) {
+        (void)vaddr;
+        (void)size;
+        (void)data;
+        (void)iswr;
+        abort();
+    }
+
+    void runenv::step_complete(u64 num_insn) {
+        (void)num_insn;
+        m_platform.notify_step();
+    }
+
+}
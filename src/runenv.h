@@ -0,0 +1,96 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef RUNENV_H
+#define RUNENV_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "ocx/ocx.h"
+#include "bbv.h"
+#include "pagemap.h"
+
+namespace ocx {
+
+    class platform;
+
+    // one runenv is created per core, so that callbacks can be attributed
+    // to the core that issued them; all shared state lives in the platform
+    class runenv : public env, public env_async_step_extension
+    {
+    private:
+        platform& m_platform;
+        u64       m_id;
+        core*     m_core;
+        bbv*      m_bbv;
+
+        std::atomic<bool> m_pending;
+        std::atomic<u64>  m_irq_state;
+        std::atomic<u64>  m_irq_dirty;
+
+        std::mutex                        m_flush_mtx;
+        std::vector<std::pair<u64, u64>> m_flushes;
+
+        // pages the core may have fetched instructions from
+        std::unique_ptr<pagemap> m_code;
+
+        runenv() = delete;
+        runenv(const runenv&) = delete;
+
+    public:
+        runenv(platform& p, u64 id);
+        virtual ~runenv();
+
+        inline u64   get_id()   const { return m_id; }
+        inline core* get_core() const { return m_core; }
+        inline void  set_bbv(bbv* b) { m_bbv = b; }
+
+        void set_core(core* c);
+
+        // can be called from any thread, requests are forwarded to the core
+        // with the next call to update; flush_code only forwards pages the
+        // core fetched code from and returns false if there are none
+        void set_irq(u64 irq, bool set);
+        bool flush_code(u64 start, u64 end);
+
+        // must be called while the core is not executing
+        void update();
+
+        u8* get_page_ptr_r(u64 page_paddr) override;
+        u8* get_page_ptr_w(u64 page_paddr) override;
+
+        void protect_page(u8* page_ptr, u64 page_addr) override;
+
+        response transport(const transaction& tx) override;
+        void signal(u64 sigid, bool set) override;
+
+        void broadcast_syscall(int callno, std::shared_ptr<void> arg,
+                               bool async) override;
+
+        u64 get_time_ps() override;
+        const char* get_param(const char* name) override;
+
+        void notify(u64 eventid, u64 time_ps) override;
+        void cancel(u64 eventid) override;
+
+        void hint(hint_kind kind) override;
+
+        void handle_begin_basic_block(u64 vaddr) override;
+        bool handle_breakpoint(u64 vaddr) override;
+        bool handle_watchpoint(u64 vaddr, u64 size, u64 data,
+                               bool iswr) override;
+
+        void step_complete(u64 num_insn) override;
+    };
+
+}
+
+#endif
@@ -10,6 +10,9 @@
 #include <vector>
 #include <stdlib.h>
 #include <functional>
+#include <chrono>
+#include <thread>
+#include <atomic>
 
 #include <ocx/ocx.h>
 #include <gtest/gtest.h>
@@ -40,7 +43,13 @@ namespace ocx {
 static const char* LIBRARY_PATH = "<library path missing>";
 static const char* CORE_VARIANT = "<variant missing>";
 
-class mock_env : public ocx::env, public ocx::env_trace_insns_extension {
+// limits for scheduling conformance, see ocx_core.stop_latency and
+// ocx_core.step_accuracy; can be changed from the command line
+static u64 MAX_STOP_LATENCY_US = 10000;
+static u64 MAX_OVERSHOOT = 64;
+
+class mock_env : public ocx::env, public ocx::env_trace_insns_extension,
+                 public ocx::env_async_step_extension {
 public:
     ~mock_env() {}
     MOCK_METHOD1(get_page_ptr_r, u8*(u64));
@@ -59,6 +68,7 @@ public:
     MOCK_METHOD1(get_param, const char*(const char*));
 
     MOCK_METHOD2(handle_trace_insn, void(u64, size_t));
+    MOCK_METHOD1(step_complete, void(u64));
 };
 
 void free_nop_code(void* buf) {
@@ -195,6 +205,180 @@ TEST(ocx_basic, core_trace_insns_extension) {
 }
 
 
+TEST(ocx_basic, core_async_step_extension) {
+    using ::testing::_;
+    corelib cl(LIBRARY_PATH);
+    ::testing::NiceMock<mock_env> env;
+    ocx::core* c = cl.create_core(env, CORE_VARIANT);
+    ASSERT_NE(c, nullptr)
+        << "failed to create core";
+
+    auto ext = ocx::query_extension<ocx::core_async_step_extension>(*c);
+    if (ext) {
+        EXPECT_CALL(env, step_complete(_)).Times(1);
+
+        u64 count = c->insn_count();
+        ASSERT_TRUE(ext->step_async(10));
+        EXPECT_FALSE(ext->step_async(10))
+            << "core accepted a second quantum while the first is pending";
+
+        u64 executed = 0;
+        auto timeout = std::chrono::steady_clock::now() +
+                       std::chrono::seconds(10);
+        while (!ext->step_poll(executed)) {
+            ASSERT_LT(std::chrono::steady_clock::now(), timeout)
+                << "asynchronous step did not complete";
+            std::this_thread::yield();
+        }
+
+        EXPECT_EQ(c->insn_count() - count, executed);
+        EXPECT_FALSE(ext->step_poll(executed))
+            << "completion of a quantum was reported twice";
+    }
+
+    cl.delete_core(c);
+}
+
+TEST(ocx_basic, core_step_time_extension) {
+    corelib cl(LIBRARY_PATH);
+    ::testing::NiceMock<mock_env> env;
+    ocx::core* c = cl.create_core(env, CORE_VARIANT);
+    ASSERT_NE(c, nullptr)
+        << "failed to create core";
+
+    auto ext = ocx::query_extension<ocx::core_step_time_extension>(*c);
+    if (ext) {
+        u64 count = c->insn_count();
+        u64 used_ps = 0;
+        u64 executed = ext->step_time(1000000, 0, used_ps);
+        EXPECT_EQ(c->insn_count() - count, executed);
+        EXPECT_GT(used_ps, 0)
+            << "core executed " << executed << " instructions in no time";
+
+        count = c->insn_count();
+        executed = ext->step_time(~0ull, 10, used_ps);
+        EXPECT_LE(executed, 10) << "core exceeded its instruction limit";
+        EXPECT_EQ(c->insn_count() - count, executed);
+    }
+
+    cl.delete_core(c);
+}
+
+TEST(ocx_basic, query_extension) {
+    corelib cl(LIBRARY_PATH);
+    mock_env env;
+    ocx::core* c = cl.create_core(env, CORE_VARIANT);
+    ASSERT_NE(c, nullptr)
+        << "failed to create core";
+
+    EXPECT_EQ(ocx::query_extension<ocx::core_inv_range_extension>(*c),
+              dynamic_cast<ocx::core_inv_range_extension*>(c))
+        << "query_extension disagrees with dynamic_cast for "
+        << "core_inv_range_extension";
+    EXPECT_EQ(ocx::query_extension<ocx::core_trace_insns_extension>(*c),
+              dynamic_cast<ocx::core_trace_insns_extension*>(c))
+        << "query_extension disagrees with dynamic_cast for "
+        << "core_trace_insns_extension";
+    EXPECT_EQ(ocx::query_extension<ocx::core_async_step_extension>(*c),
+              dynamic_cast<ocx::core_async_step_extension*>(c))
+        << "query_extension disagrees with dynamic_cast for "
+        << "core_async_step_extension";
+    EXPECT_EQ(ocx::query_extension<ocx::core_step_time_extension>(*c),
+              dynamic_cast<ocx::core_step_time_extension*>(c))
+        << "query_extension disagrees with dynamic_cast for "
+        << "core_step_time_extension";
+
+    EXPECT_EQ(c->query_extension(0), nullptr)
+        << "core returned an interface for an invalid extension id";
+    EXPECT_EQ(c->query_extension(ocx::EXT_CORE_INV_RANGE + 0xffff), nullptr)
+        << "core returned an interface for an unknown extension version";
+
+    ocx::env& e = env;
+    EXPECT_EQ(ocx::query_extension<ocx::env_trace_insns_extension>(e),
+              dynamic_cast<ocx::env_trace_insns_extension*>(&e));
+    EXPECT_EQ(ocx::query_extension<ocx::env_set_exclusive_extension>(e),
+              dynamic_cast<ocx::env_set_exclusive_extension*>(&e));
+    EXPECT_EQ(ocx::query_extension<ocx::env_callbacks_extension>(e),
+              dynamic_cast<ocx::env_callbacks_extension*>(&e));
+    EXPECT_EQ(ocx::query_extension<ocx::env_async_step_extension>(e),
+              dynamic_cast<ocx::env_async_step_extension*>(&e));
+
+    cl.delete_core(c);
+}
+
+TEST(ocx_basic, env_callbacks_extension) {
+    using ::testing::Return;
+    using ::testing::_;
+    ::testing::NiceMock<ocx::env_callbacks_adapter<mock_env>> env;
+
+    u8 page[16];
+    ON_CALL(env, get_page_ptr_r(0x1000)).WillByDefault(Return(page));
+    ON_CALL(env, get_page_ptr_w(0x1000)).WillByDefault(Return(page + 8));
+    ON_CALL(env, transport(_)).WillByDefault(Return(RESP_ADDRESS_ERROR));
+
+    auto ext = ocx::query_extension<ocx::env_callbacks_extension>(env);
+    ASSERT_NE(ext, nullptr);
+    EXPECT_EQ(ext, dynamic_cast<ocx::env_callbacks_extension*>(&env));
+
+    const ocx::env_callbacks* cb = ext->get_callbacks();
+    ASSERT_NE(cb, nullptr);
+    EXPECT_EQ(cb->get_page_ptr_r(cb->ctx, 0x1000), env.get_page_ptr_r(0x1000));
+    EXPECT_EQ(cb->get_page_ptr_w(cb->ctx, 0x1000), env.get_page_ptr_w(0x1000));
+
+    u32 data = 0;
+    transaction tx = {};
+    tx.addr = 0x2000;
+    tx.size = sizeof(data);
+    tx.data = (u8*)&data;
+    tx.is_read = true;
+    EXPECT_EQ(cb->transport(cb->ctx, tx), env.transport(tx));
+
+    EXPECT_CALL(env, handle_begin_basic_block(0x42)).Times(2);
+    cb->handle_begin_basic_block(cb->ctx, 0x42);
+    env.handle_begin_basic_block(0x42);
+
+    corelib cl(LIBRARY_PATH);
+    ocx::core* c = cl.create_core(env, CORE_VARIANT);
+    ASSERT_NE(c, nullptr)
+        << "failed to create core with callback table env";
+    cl.delete_core(c);
+}
+
+class ptr_env : public mock_env {
+public:
+    u8* get_page_ptr_r(u64 page_paddr) override {
+        return (u8*)(uintptr_t)(page_paddr ^ 0x1000);
+    }
+};
+
+TEST(ocx_basic, env_callbacks_cost) {
+    using namespace std::chrono;
+    const u64 iterations = 10000000;
+
+    ocx::env_callbacks_adapter<ptr_env> env;
+    ocx::env* volatile vptr = &env;
+    const ocx::env_callbacks* cb = env.get_callbacks();
+
+    uintptr_t sum_virt = 0;
+    auto t0 = steady_clock::now();
+    for (u64 i = 0; i < iterations; ++i)
+        sum_virt += (uintptr_t)vptr->get_page_ptr_r(i << 12);
+    auto t1 = steady_clock::now();
+
+    uintptr_t sum_table = 0;
+    for (u64 i = 0; i < iterations; ++i)
+        sum_table += (uintptr_t)cb->get_page_ptr_r(cb->ctx, i << 12);
+    auto t2 = steady_clock::now();
+
+    EXPECT_EQ(sum_virt, sum_table);
+
+    double ns_virt  = duration<double, std::nano>(t1 - t0).count();
+    double ns_table = duration<double, std::nano>(t2 - t1).count();
+    std::cout << "get_page_ptr_r: virtual "
+              << ns_virt / iterations << " ns/call, table "
+              << ns_table / iterations << " ns/call" << std::endl;
+}
+
 
 class ocx_core : public ::testing::Test
 {
@@ -462,6 +646,108 @@ TEST_F(ocx_core, disassemble) {
     free_nop_code(codebuf);
 }
 
+ACTION_P(GetNopPage, codebuf) {
+    (void)arg0;
+    return (u8*)codebuf;
+}
+
+TEST_F(ocx_core, stop_latency) {
+    using ::testing::_;
+    using namespace std::chrono;
+
+    // map the same page of NOPs everywhere, so that the core can run for
+    // as long as we let it
+    void *codebuf = prepare_nop_code(c->page_size(), c->arch_family());
+    ASSERT_NE(codebuf, nullptr) <<
+            "could not prepare NOP code for " << c->arch_family();
+
+    ON_CALL(env, get_page_ptr_r(_)).WillByDefault(GetNopPage(codebuf));
+    ON_CALL(env, get_page_ptr_w(_)).WillByDefault(GetNopPage(codebuf));
+
+    c->reset();
+
+    u64 start = 0;
+    ASSERT_TRUE(c->write_reg(c->pc_regid(), &start))
+        << "failed to set PC";
+
+    const int runs = 10;
+    u64 max_latency_us = 0;
+    for (int i = 0; i < runs; ++i) {
+        std::atomic<bool> returned(false);
+        steady_clock::time_point stopped, done;
+        u64 count = c->insn_count();
+        u64 executed = 0;
+
+        std::thread t([&]() {
+            executed = c->step(~0ull >> 1);
+            done = steady_clock::now();
+            returned = true;
+        });
+
+        std::this_thread::sleep_for(milliseconds(5));
+        stopped = steady_clock::now();
+        c->stop();
+        t.join();
+
+        u64 latency_us = 0;
+        if (done > stopped)
+            latency_us = duration_cast<microseconds>(done - stopped).count();
+        if (latency_us > max_latency_us)
+            max_latency_us = latency_us;
+
+        EXPECT_TRUE(returned);
+        EXPECT_EQ(c->insn_count() - count, executed)
+            << "insn_count does not match instructions returned by step";
+    }
+
+    std::cout << "stop latency: " << max_latency_us << " us max over "
+              << runs << " runs" << std::endl;
+    EXPECT_LE(max_latency_us, MAX_STOP_LATENCY_US)
+        << "step returned " << max_latency_us << "us after stop";
+
+    free_nop_code(codebuf);
+}
+
+TEST_F(ocx_core, step_accuracy) {
+    using ::testing::_;
+
+    void *codebuf = prepare_nop_code(c->page_size(), c->arch_family());
+    ASSERT_NE(codebuf, nullptr) <<
+            "could not prepare NOP code for " << c->arch_family();
+
+    ON_CALL(env, get_page_ptr_r(_)).WillByDefault(GetNopPage(codebuf));
+    ON_CALL(env, get_page_ptr_w(_)).WillByDefault(GetNopPage(codebuf));
+
+    c->reset();
+
+    u64 start = 0;
+    ASSERT_TRUE(c->write_reg(c->pc_regid(), &start))
+        << "failed to set PC";
+
+    const u64 quanta[] = {
+        1, 2, 3, 5, 7, 10, 16, 64, 100, 999, 1000, 1024, 4096, 10000,
+        65536, 100000, 1000000
+    };
+
+    for (u64 quantum : quanta) {
+        for (int i = 0; i < 4; ++i) {
+            u64 count = c->insn_count();
+            u64 executed = c->step(quantum);
+
+            EXPECT_EQ(c->insn_count() - count, executed)
+                << "insn_count does not match instructions returned by step "
+                << "for quantum " << quantum;
+            EXPECT_GE(executed, quantum)
+                << "step returned early for quantum " << quantum;
+            EXPECT_LE(executed, quantum + MAX_OVERSHOOT)
+                << "step overshot quantum " << quantum << " by "
+                << executed - quantum << " instructions";
+        }
+    }
+
+    free_nop_code(codebuf);
+}
+
 TEST_F(ocx_core, tb_flush) {
     // hard to actually test, but check that we can call the flush
     // methods without crashing the core
@@ -469,12 +755,34 @@ TEST_F(ocx_core, tb_flush) {
     c->tb_flush_page(0x0, 0x8192);
 }
 
+static bool parse_limit(const char* arg, const char* name, u64& limit) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=')
+        return false;
+    limit = strtoull(arg + len + 1, nullptr, 0);
+    return true;
+}
+
 int main(int argc, char** argv) {
     try {
         ::testing::InitGoogleTest(&argc, argv);
+
+        int nargs = 1;
+        for (int i = 1; i < argc; ++i) {
+            if (parse_limit(argv[i], "--ocx_max_stop_latency_us",
+                            MAX_STOP_LATENCY_US))
+                continue;
+            if (parse_limit(argv[i], "--ocx_max_overshoot", MAX_OVERSHOOT))
+                continue;
+            argv[nargs++] = argv[i];
+        }
+
+        argc = nargs;
         if (argc != 3) {
-            std::cerr << "Usage: ocx-test [gtest args] <path_to_ocx_lib> <variant>"
-                      << std::endl;
+            std::cerr << "Usage: ocx-test [gtest args] "
+                      << "[--ocx_max_stop_latency_us=N] "
+                      << "[--ocx_max_overshoot=N] "
+                      << "<path_to_ocx_lib> <variant>" << std::endl;
             return -1;
         }
 
@@ -0,0 +1,278 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#include "common.h"
+#include "topology.h"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace ocx {
+
+    static const char* const SYSFS_CPU  = "/sys/devices/system/cpu";
+    static const char* const SYSFS_NODE = "/sys/devices/system/node";
+
+    static int read_int(const std::string& path, int fallback) {
+        std::ifstream file(path);
+        int val;
+        if (!(file >> val))
+            return fallback;
+        return val;
+    }
+
+    // parses lists like "0-3,8-11"
+    static std::vector<int> read_list(const std::string& path) {
+        std::vector<int> result;
+        std::ifstream file(path);
+        std::string list;
+        if (!std::getline(file, list))
+            return result;
+
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            int first, last;
+            if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2) {
+                for (int i = first; i <= last; ++i)
+                    result.push_back(i);
+            } else if (sscanf(range.c_str(), "%d", &first) == 1) {
+                result.push_back(first);
+            }
+        }
+
+        return result;
+    }
+
+    topology::topology() :
+        m_cpus(),
+        m_num_nodes(1) {
+        std::string cpu_dir = SYSFS_CPU;
+        std::string node_dir = SYSFS_NODE;
+
+        for (int cpu : read_list(cpu_dir + "/online")) {
+            std::string topo = cpu_dir + "/cpu" + std::to_string(cpu) +
+                               "/topology/";
+            std::vector<int> siblings = read_list(topo +
+                                                  "thread_siblings_list");
+            auto it = std::find(siblings.begin(), siblings.end(), cpu);
+
+            cpu_info info;
+            info.cpu = cpu;
+            info.node = 0;
+            info.package = read_int(topo + "physical_package_id", 0);
+            info.core = read_int(topo + "core_id", cpu);
+            info.sibling = it != siblings.end() ? it - siblings.begin() : 0;
+            m_cpus.push_back(info);
+        }
+
+        if (m_cpus.empty()) {
+            int n = std::max(1u, std::thread::hardware_concurrency());
+            for (int cpu = 0; cpu < n; ++cpu)
+                m_cpus.push_back({cpu, 0, 0, cpu, 0});
+        }
+
+        for (int node : read_list(node_dir + "/online")) {
+            std::string list = node_dir + "/node" + std::to_string(node) +
+                               "/cpulist";
+            for (int cpu : read_list(list)) {
+                for (auto& info : m_cpus) {
+                    if (info.cpu == cpu)
+                        info.node = node;
+                }
+            }
+
+            m_num_nodes = std::max(m_num_nodes, node + 1);
+        }
+    }
+
+    topology::~topology() {
+    }
+
+    const topology::cpu_info* topology::find(int cpu) const {
+        for (auto& info : m_cpus) {
+            if (info.cpu == cpu)
+                return &info;
+        }
+
+        return nullptr;
+    }
+
+    int topology::node_of(int cpu) const {
+        const cpu_info* info = find(cpu);
+        return info != nullptr ? info->node : 0;
+    }
+
+    std::vector<int> topology::assign(pin_policy policy, size_t ncores) const {
+        std::vector<int> result;
+        if (policy == PIN_NONE)
+            return result;
+
+        // per node, use one hardware thread of every physical core before
+        // using their siblings
+        std::vector<std::vector<cpu_info>> nodes(m_num_nodes);
+        for (auto& info : m_cpus)
+            nodes[info.node].push_back(info);
+
+        for (auto& node : nodes) {
+            std::sort(node.begin(), node.end(),
+                      [](const cpu_info& a, const cpu_info& b) {
+                if (a.sibling != b.sibling)
+                    return a.sibling < b.sibling;
+                if (a.package != b.package)
+                    return a.package < b.package;
+                if (a.core != b.core)
+                    return a.core < b.core;
+                return a.cpu < b.cpu;
+            });
+        }
+
+        std::vector<int> order;
+        if (policy == PIN_COMPACT) {
+            for (auto& node : nodes) {
+                for (auto& info : node)
+                    order.push_back(info.cpu);
+            }
+        } else {
+            for (size_t i = 0; order.size() < m_cpus.size(); ++i) {
+                for (auto& node : nodes) {
+                    if (i < node.size())
+                        order.push_back(node[i].cpu);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < ncores; ++i)
+            result.push_back(order[i % order.size()]);
+
+        return result;
+    }
+
+#ifdef __linux__
+
+    static bool do_mbind(u8* ptr, u64 size, int mode, unsigned long mask) {
+        long ret = syscall(SYS_mbind, ptr, size, mode, &mask,
+                           sizeof(mask) * 8 + 1, MPOL_MF_MOVE);
+        return ret == 0;
+    }
+
+    static void touch(u8* ptr, u64 size, int cpu) {
+        topology::pin_thread(cpu);
+        const u64 page_size = sysconf(_SC_PAGESIZE);
+        for (u64 off = 0; off < size; off += page_size) {
+            volatile u8* p = ptr + off;
+            *p = *p;
+        }
+    }
+
+#endif
+
+    void topology::place(numa_policy policy, memory& mem,
+                         const std::vector<int>& cpus) const {
+#ifdef __linux__
+        u8* ptr = mem.get_ptr();
+        u64 size = mem.get_size();
+
+        ERROR_ON(m_num_nodes > (int)(sizeof(unsigned long) * 8),
+                 "too many NUMA nodes");
+
+        switch (policy) {
+        case NUMA_DEFAULT:
+            return;
+
+        case NUMA_INTERLEAVE: {
+            unsigned long mask = 0;
+            for (int node = 0; node < m_num_nodes; ++node)
+                mask |= 1ul << node;
+            if (!do_mbind(ptr, size, MPOL_INTERLEAVE, mask))
+                INFO("mbind failed: %s", strerror(errno));
+            return;
+        }
+
+        case NUMA_BIND:
+        case NUMA_FIRST_TOUCH: {
+            ERROR_ON(cpus.empty(), "NUMA placement requires pinned cores");
+
+            // split memory into one page aligned region per core
+            const u64 page_size = sysconf(_SC_PAGESIZE);
+            u64 region = (size / cpus.size() + page_size - 1) &
+                         ~(page_size - 1);
+
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < cpus.size(); ++i) {
+                u64 start = std::min(size, i * region);
+                u64 len = std::min(size - start, region);
+                if (len == 0)
+                    break;
+
+                if (policy == NUMA_FIRST_TOUCH) {
+                    threads.emplace_back(touch, ptr + start, len, cpus[i]);
+                    continue;
+                }
+
+                unsigned long mask = 1ul << node_of(cpus[i]);
+                if (!do_mbind(ptr + start, len, MPOL_BIND, mask))
+                    INFO("mbind failed: %s", strerror(errno));
+            }
+
+            for (auto& t : threads)
+                t.join();
+            return;
+        }
+
+        default:
+            ERROR("unknown NUMA policy %d", (int)policy);
+        }
+#else
+        (void)mem;
+        (void)cpus;
+        if (policy != NUMA_DEFAULT)
+            INFO("NUMA placement not supported on this host");
+#endif
+    }
+
+    topology::numastat topology::read_numastat() const {
+        numastat result = { 0, 0 };
+        for (int node = 0; node < m_num_nodes; ++node) {
+            std::ifstream file(std::string(SYSFS_NODE) + "/node" +
+                               std::to_string(node) + "/numastat");
+            std::string key;
+            u64 val;
+            while (file >> key >> val) {
+                if (key == "local_node")
+                    result.local += val;
+                else if (key == "other_node")
+                    result.other += val;
+            }
+        }
+
+        return result;
+    }
+
+    bool topology::pin_thread(int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+}
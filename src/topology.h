@@ -0,0 +1,79 @@
+/*******************************************************************************
+* Copyright (C) 2022 Synopsys, Inc.
+* This source code is licensed under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2 of the License
+* or (at your option) any later version.
+*******************************************************************************/
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <vector>
+
+#include "ocx/ocx.h"
+#include "memory.h"
+
+namespace ocx {
+
+    enum pin_policy {
+        PIN_NONE = 0,
+        PIN_COMPACT, // fill one NUMA node after the other
+        PIN_SCATTER, // distribute core threads round-robin across nodes
+    };
+
+    enum numa_policy {
+        NUMA_DEFAULT = 0,
+        NUMA_INTERLEAVE,  // interleave guest memory pages across all nodes
+        NUMA_BIND,        // bind each core's share of memory to its node
+        NUMA_FIRST_TOUCH, // let each core's thread fault in its share
+    };
+
+    // Host cpu and NUMA topology as reported by sysfs. Without sysfs, all
+    // online cpus are assumed to belong to a single node.
+    class topology
+    {
+    private:
+        struct cpu_info {
+            int cpu;
+            int node;
+            int package;
+            int core;
+            int sibling;
+        };
+
+        std::vector<cpu_info> m_cpus;
+        int m_num_nodes;
+
+        const cpu_info* find(int cpu) const;
+
+    public:
+        struct numastat {
+            u64 local;
+            u64 other;
+        };
+
+        topology();
+        virtual ~topology();
+
+        inline size_t num_cpus()  const { return m_cpus.size(); }
+        inline int    num_nodes() const { return m_num_nodes; }
+
+        int node_of(int cpu) const;
+
+        // returns the host cpu for each of ncores core threads
+        std::vector<int> assign(pin_policy policy, size_t ncores) const;
+
+        // applies the placement policy to guest memory, where cpus holds the
+        // host cpus of the core threads as returned by assign
+        void place(numa_policy policy, memory& mem,
+                   const std::vector<int>& cpus) const;
+
+        // sum of the page allocation counters of all nodes
+        numastat read_numastat() const;
+
+        static bool pin_thread(int cpu);
+    };
+
+}
+
+#endif